@@ -1,6 +1,17 @@
 #include "node.h"
 
-static LINK link;
+static LINK links[NODE_MAX_LINKS];
+static uint8_t total_links = 0;
+
+static uint8_t my_id;
+static FRAME_HANDLER my_mparser;
+static void *my_mparser_ctx;
+static GROUP_MASK my_groups = 0;
+
+//Liveness of each attached link
+static unsigned long last_heard[NODE_MAX_LINKS];
+static unsigned long last_ping[NODE_MAX_LINKS];
+static uint8_t link_up[NODE_MAX_LINKS];
 
 /******************************/
 //Node functions
@@ -17,60 +28,254 @@ void proc_frame(FRAME frame, LINK *link)
     return;
   }
 
+  //Drop multicasts for groups we are not in, before they reach the user's parsers
+  if (frame.preamble == GFRAME_PREAMBLE && !(my_groups & GROUP_BIT(frame.dst)))
+  {
+    free(frame.payload);
+    return;
+  }
+
   //Handle broadcast packets. End nodes will treat broadcast frames as normal frames
-  if (frame.dst == MAX_ADDRESS)
+  if (frame.dst == MAX_ADDRESS && frame.preamble != GFRAME_PREAMBLE)
     printf("Broadcasting Packet!\n");
 
-  //Call the user's message parser
-  message_handler(frame);
+  //Call the user's message parsers registered on this link
+  dispatch_frame_event(MESSAGE_EVENT, frame, link);
   free(frame.payload);
   return;
 
   //Send the received frame to the transport layer for further processing
-  //parse_recvd_frame(frame);
+  //transport_recv_frame(tr, frame);
 
 }
 
 
+/******************************/
+//Link selection
+/******************************/
+
+//Mark links that have been quiet for too long as down, and ping the ones due for a HELLO
+void check_links()
+{
+  uint8_t i;
+  unsigned long now = millis();
+
+  for (i = 0; i < total_links; i++)
+  {
+    if (now - last_ping[i] >= NODE_PING_MS)
+    {
+      last_ping[i] = now;
+      send_hello(my_id, 0, &links[i]);
+    }
+
+    if (link_up[i] && now - last_heard[i] > NODE_LINK_TIMEOUT_MS)
+    {
+      printf("ALERT: Link %u is down! Failing over...\n", i);
+      link_up[i] = 0;
+    }
+  }
+}
+
+
+//Pick the live link with the fewest hops to dst. Ties are spread by picking the link with the least queued frames.
+LINK* node_select_link(uint8_t dst)
+{
+  static uint8_t rr = 0;
+  uint8_t i, idx, best = NODE_MAX_LINKS;
+  uint8_t hops, best_hops = 0xFF;
+
+  if (total_links == 0)
+    return NULL;
+
+  //Rotate the starting point so equally loaded links take turns
+  rr = (rr + 1) % total_links;
+
+  for (i = 0; i < total_links; i++)
+  {
+    idx = (rr + i) % total_links;
+
+    if (!link_up[idx])
+      continue;
+
+    //Broadcasts go out on any live link
+    hops = (dst == MAX_ADDRESS) ? 1 : RT_HOPS(&links[idx], dst);
+    if (hops == 0)
+      continue;
+
+    if (hops < best_hops || (hops == best_hops && links[idx].squeue_pending < links[best].squeue_pending))
+    {
+      best = idx;
+      best_hops = hops;
+    }
+  }
+
+  if (best == NODE_MAX_LINKS)
+    return NULL;
+
+  return &links[best];
+}
+
+
+uint8_t node_send_frame(uint8_t dst, uint8_t size, uchar *payload)
+{
+  LINK *link = node_select_link(dst);
+
+  if (link == NULL)
+  {
+    printf("No live link can reach node %d! Dropping...\n", dst);
+    return 0;
+  }
+
+  return create_send_frame(my_id, dst, size, payload, link);
+}
+
+
+//Multicast to everyone subscribed to the group. The switch replicates it only towards subscribers
+uint8_t node_send_group(uint8_t group, uint8_t size, uchar *payload)
+{
+  LINK *link = node_select_link(MAX_ADDRESS);
+
+  if (link == NULL || group >= MAX_GROUPS)
+  {
+    printf("Cannot multicast to group %d! Dropping...\n", group);
+    return 0;
+  }
+
+  return create_send_gframe(my_id, group, size, payload, link);
+}
+
+
+/******************************/
+//Multicast groups
+/******************************/
+
+//Subscribe on every attached link, so the group keeps flowing if one of them fails
+void node_join_group(uint8_t group)
+{
+  uint8_t i;
+
+  if (group >= MAX_GROUPS)
+    return;
+
+  my_groups |= GROUP_BIT(group);
+  for (i = 0; i < total_links; i++)
+    send_group_msg(my_id, group, 1, &links[i]);
+}
+
+
+void node_leave_group(uint8_t group)
+{
+  uint8_t i;
+
+  if (group >= MAX_GROUPS)
+    return;
+
+  my_groups &= ~GROUP_BIT(group);
+  for (i = 0; i < total_links; i++)
+    send_group_msg(my_id, group, 0, &links[i]);
+}
+
+
 /******************************/
 //main
 /******************************/
 
-LINK* node_init(uint8_t id, int8_t (*mparser)(FRAME))
+LINK* node_add_link(HardwareSerial *port)
 {
-  //Initializing transport layer data for serial1
-  Serial1.begin(115200);
-  link_init(&Serial1, id, ENDPOINT, &link);
+  LINK *link;
+
+  if (total_links >= NODE_MAX_LINKS)
+  {
+    printf("ERROR: Cannot attach more than %d links\n", NODE_MAX_LINKS);
+    return NULL;
+  }
+
+  link = &links[total_links];
+
+  //Initializing transport layer data for this port
+  port->begin(NODE_LINK_BAUD);
+  link_init(port, my_id, ENDPOINT, link);
 
   //Set the message parser
-  set_message_handler(mparser);
+  add_frame_handler(link, MESSAGE_EVENT, my_mparser, my_mparser_ctx);
 
-  //Send out a HELLO message out onto the link
-  send_hello(link.id, 0, &link);
+  //Send out a HELLO message out onto the link. The link is assumed up until proven otherwise
+  last_heard[total_links] = millis();
+  last_ping[total_links] = millis();
+  link_up[total_links] = 1;
+  send_hello(my_id, 0, link);
 
-  return &link;
+  total_links++;
+  return link;
 }
 
+
+//Primary link is always Serial1. Additional links can be attached with node_add_link()
+LINK* node_init(uint8_t id, FRAME_HANDLER mparser, void *ctx)
+{
+  my_id = id;
+  my_mparser = mparser;
+  my_mparser_ctx = ctx;
+
+  return node_add_link(&Serial1);
+}
+
+
+//Announce ourselves on a link, along with the groups we are in
+void join_link(LINK *link)
+{
+  uint8_t group;
+
+  send_join_msg(my_id, link);
+
+  for (group = 0; group < MAX_GROUPS; group++)
+    if (my_groups & GROUP_BIT(group))
+      send_group_msg(my_id, group, 1, link);
+}
+
+
+void node_join()
+{
+  uint8_t i;
+
+  for (i = 0; i < total_links; i++)
+    join_link(&links[i]);
+}
+
+
 //uint8_t done = 0;
 void net_task(uint8_t continuous)
 {
+  uint8_t i;
+
   while (1)
   {
-
-    //Attempt to read serial. Process any pending frames if received anything new
-    if (read_serial(&link) > 0)
+    for (i = 0; i < total_links; i++)
     {
-      while (link.rqueue_pending > 0)
-        proc_frame(pop_recv_queue(&link), &link);
+      //Attempt to read serial. Process any pending frames if received anything new
+      if (read_serial(&links[i]) > 0)
+      {
+        last_heard[i] = millis();
+
+        //The switch has likely declared us dead meanwhile, and cleared our groups with us
+        if (!link_up[i])
+        {
+          printf("Link %u is back up\n", i);
+          link_up[i] = 1;
+          join_link(&links[i]);
+        }
+
+        while (links[i].rqueue_pending > 0)
+          proc_frame(pop_recv_queue(&links[i]), &links[i]);
+      }
+
+      //Transmit a packet in the sending queue, if any
+      transmit_next(&links[i]);
     }
 
-    //Transmit a packet in the sending queue, if any
-    transmit_next(&link);
+    check_links();
     delay(100);
 
     if (!continuous) break;
   }
 }
-
-
-
@@ -5,10 +5,26 @@
 #include <link.h>
 
 
-//LINK link;
+//Multi-homing Configuration
+#define NODE_MAX_LINKS			3
+#define NODE_LINK_BAUD			115200
+#define NODE_PING_MS			12000		//Longer than IGNORE_PING_UNDER, so the switch always replies
+#define NODE_LINK_TIMEOUT_MS	(3 * NODE_PING_MS)
 
-LINK* node_init(uint8_t id, int8_t (*mparser)(FRAME));
+
+LINK* node_init(uint8_t id, FRAME_HANDLER mparser, void *ctx);
+LINK* node_add_link(HardwareSerial *port);
+void node_join();
 void net_task(uint8_t continuous);
 
+//Multi-homed sending. The outgoing link is chosen from the routing tables of every live link
+LINK* node_select_link(uint8_t dst);
+uint8_t node_send_frame(uint8_t dst, uint8_t size, uchar *payload);
+
+//Multicast groups. Frames for groups we have not joined are dropped before the user's parser
+void node_join_group(uint8_t group);
+void node_leave_group(uint8_t group);
+uint8_t node_send_group(uint8_t group, uint8_t size, uchar *payload);
+
 
 #endif
@@ -1,35 +1,523 @@
 #include "switch.h"
 
 static LINK links[TOTAL_LINKS];
+static uint8_t total_links = 0;                 //Ports in use, from the port table given to switch_init_ports()
+
+/******************************/
+//Forwarding table
+/******************************/
+
+//Consolidated view of every link's rtable: the egress port and hop count for each destination.
+//Kept up to date by refresh_route() whenever any rtable entry changes, so lookups on the forwarding path are O(1).
+//An egress port is the index of a link, or of the primary link of a bond.
+static uint8_t fwd_link[MAX_ADDRESS + 1];       //TOTAL_LINKS if unreachable
+static uint8_t fwd_hops[MAX_ADDRESS + 1];       //0 if unreachable
+static uint16_t fwd_lat[MAX_ADDRESS + 1];       //Latency metric of the chosen path, RT_METRIC_UNREACHABLE if unreachable
+static uint16_t fwd_lat_adv[MAX_ADDRESS + 1];   //Latency metric as of the last time the entry was advertised
+
+//Latency to each id advertised by the neighbouring switch on each link
+static uint16_t adv_lat[TOTAL_LINKS][MAX_ADDRESS];
+
+void mark_route_changed(uint8_t id);
+
+
+/******************************/
+//Link aggregation
+/******************************/
+
+//Links to the same neighbouring switch (recognized by its HELLO nonce) are bonded into one logical port.
+//The lowest-indexed live member is the bond's primary, and stands for the whole bond in the forwarding table.
+static uint8_t bond_of[TOTAL_LINKS];            //Primary of the bond each link belongs to. Itself if not bonded
+static uint8_t peer_nonce[TOTAL_LINKS];         //HELLO nonce of the switch at the other end, 0 if not a switch
+static uint8_t member_up[TOTAL_LINKS];          //Heartbeat state of switch-to-switch links
+static unsigned long last_heard[TOTAL_LINKS];
+static uint8_t bond_mode = BOND_FLOW_HASH;
+
+
+uint8_t link_usable(uint8_t i)
+{
+  if (links[i].end_link_type == UNKNOWN)
+    return 0;
+
+  return links[i].end_link_type != GATEWAY || member_up[i];
+}
+
+
+//Pick the member of the bond behind port that carries a frame from src to dst
+uint8_t bond_member(uint8_t port, uint8_t src, uint8_t dst)
+{
+  static uint8_t rr = 0;
+  uint8_t i, n, count = 0;
+  uint8_t members[TOTAL_LINKS];
+
+  for (i = port; i < total_links; i++)
+    if (bond_of[i] == port && link_usable(i))
+      members[count++] = i;
+
+  if (count <= 1)
+    return port;
+
+  //Per-flow hashing keeps each src/dst pair on one member, so its frames stay in order
+  if (bond_mode == BOND_ROUND_ROBIN)
+    n = rr++ % count;
+  else
+    n = ((src << ADDRESS_WIDTH) | dst) % count;
+
+  return members[n];
+}
+
+
+void switch_set_bond_mode(uint8_t mode)
+{
+  bond_mode = mode;
+}
+
+
+//Regroup links into bonds after a neighbour was identified, or a member went up or down
+void rebuild_bonds()
+{
+  uint8_t i, j;
+
+  for (i = 0; i < total_links; i++)
+  {
+    bond_of[i] = i;
+
+    if (links[i].end_link_type != GATEWAY || !member_up[i] || peer_nonce[i] == 0)
+      continue;
+
+    for (j = 0; j < i; j++)
+    {
+      if (bond_of[j] == j && member_up[j] && peer_nonce[j] == peer_nonce[i])
+      {
+        bond_of[i] = j;
+        break;
+      }
+    }
+  }
+}
+
+
+/******************************/
+//Forwarding table maintenance
+/******************************/
+
+//Latency metric of reaching id through link i: the link's own cost, plus whatever the switch behind it advertised
+uint16_t path_metric(uint8_t i, uint8_t id)
+{
+  uint32_t metric;
+
+  if (RT_HOPS(&links[i], id) == 0 || !link_usable(i))
+    return RT_METRIC_UNREACHABLE;
+
+  //Directly attached endpoint
+  if (links[i].end_link_type != GATEWAY)
+    return link_cost(&links[i]);
+
+  metric = (uint32_t)adv_lat[i][id] + link_cost(&links[i]);
+  return (metric >= RT_METRIC_UNREACHABLE) ? RT_METRIC_UNREACHABLE - 1 : metric;
+}
+
+
+//How much better a path has to be before we move to it, or how far the metric has to drift before it is re-advertised
+inline uint16_t metric_margin(uint16_t metric)
+{
+  return max(RT_HYSTERESIS_MS, metric >> 3);
+}
+
+
+//Best member of the given port, or TOTAL_LINKS if the port cannot reach id
+uint8_t best_member_to(uint8_t port, uint8_t id)
+{
+  uint8_t i, best = TOTAL_LINKS;
+  uint16_t metric, best_metric = RT_METRIC_UNREACHABLE;
+
+  for (i = port; i < total_links; i++)
+  {
+    if (bond_of[i] != port)
+      continue;
+
+    metric = path_metric(i, id);
+    if (metric < best_metric)
+    {
+      best = i;
+      best_metric = metric;
+    }
+  }
+
+  return best;
+}
+
+
+//Recompute the forwarding entry for id from all usable links, minimizing the latency metric (then hops, then index).
+//The current port is kept unless another is better by more than metric_margin(), so routes do not flap on RTT noise.
+//Changes worth telling the neighbours about are marked for the next sync_routes().
+void refresh_route(uint8_t id)
+{
+  uint8_t i, best = TOTAL_LINKS, cur;
+  uint8_t old_link, old_hops;
+  uint16_t metric, best_metric = RT_METRIC_UNREACHABLE;
+
+  if (id == 0 || id >= MAX_ADDRESS)
+    return;
+
+  for (i = 0; i < total_links; i++)
+  {
+    metric = path_metric(i, id);
+
+    if (metric < best_metric || (metric == best_metric && metric != RT_METRIC_UNREACHABLE && RT_HOPS(&links[i], id) < RT_HOPS(&links[best], id)))
+    {
+      best = i;
+      best_metric = metric;
+    }
+  }
+
+  //Hysteresis against the port we are using now
+  if (best != TOTAL_LINKS && fwd_link[id] != TOTAL_LINKS && bond_of[best] != fwd_link[id])
+  {
+    cur = best_member_to(fwd_link[id], id);
+
+    if (cur != TOTAL_LINKS && best_metric + metric_margin(path_metric(cur, id)) >= path_metric(cur, id))
+    {
+      best = cur;
+      best_metric = path_metric(cur, id);
+    }
+  }
+
+  old_link = fwd_link[id];
+  old_hops = fwd_hops[id];
+
+  fwd_link[id] = (best == TOTAL_LINKS) ? TOTAL_LINKS : bond_of[best];
+  fwd_hops[id] = (best == TOTAL_LINKS) ? 0 : RT_HOPS(&links[best], id);
+  fwd_lat[id] = best_metric;
+
+  //A new egress port also changes what gets poisoned, so it is advertised even if the metric stayed put
+  if (fwd_link[id] != old_link || fwd_hops[id] != old_hops)
+    mark_route_changed(id);
+  else if (best != TOTAL_LINKS && abs((int32_t)fwd_lat[id] - fwd_lat_adv[id]) > metric_margin(fwd_lat_adv[id]))
+    mark_route_changed(id);
+}
+
+
+//Recompute every forwarding entry, e.g. after links went up or down or their RTT moved
+void refresh_all_routes()
+{
+  uint8_t id;
+
+  for (id = 1; id < MAX_ADDRESS; id++)
+    refresh_route(id);
+}
+
+
+#ifndef SWITCH_FWD_SCAN
+
+//Egress port (link or bond primary) with the fewest hops to id, or TOTAL_LINKS if unreachable
+inline uint8_t best_link(uint8_t id)
+{
+  return fwd_link[id];
+}
+
+
+//Best hop count to id across all links, 0 if unreachable
+inline uint8_t route_hops(uint8_t id)
+{
+  return fwd_hops[id];
+}
+
+#else
+
+//Lookups scan every link's rtable, the way they did before the forwarding table. Only there to measure what the table
+//saves (see the fwd_bench host example): it goes by hops alone, without the latency metric or hysteresis
+uint8_t best_link(uint8_t id)
+{
+  uint8_t i, best = TOTAL_LINKS;
+  uint8_t best_hops = RT_INFINITY;
+
+  if (id == 0 || id >= MAX_ADDRESS)
+    return TOTAL_LINKS;
+
+  for (i = 0; i < TOTAL_LINKS; i++)
+  {
+    if (RT_HOPS(&links[i], id) > 0 && RT_HOPS(&links[i], id) < best_hops && link_usable(i))
+    {
+      best = i;
+      best_hops = RT_HOPS(&links[i], id);
+    }
+  }
+
+  return (best == TOTAL_LINKS) ? TOTAL_LINKS : bond_of[best];
+}
+
+
+uint8_t route_hops(uint8_t id)
+{
+  uint8_t i = best_link(id);
+
+  return (i == TOTAL_LINKS) ? 0 : RT_HOPS(&links[i], id);
+}
+
+#endif
+
+
+//Heartbeat switch-to-switch links. Members that go quiet are pulled out of their bond, and routes fail over
+void check_members()
+{
+  static unsigned long last_hello = 0;
+  uint8_t i, up, changed = 0;
+  unsigned long now = millis();
+
+  if (now - last_hello >= GATEWAY_HELLO_MS)
+  {
+    last_hello = now;
+    for (i = 0; i < total_links; i++)
+      if (links[i].end_link_type == GATEWAY)
+        send_hello(0, 0, &links[i]);
+  }
+
+  for (i = 0; i < total_links; i++)
+  {
+    if (links[i].end_link_type != GATEWAY)
+      continue;
+
+    up = (now - last_heard[i]) < GATEWAY_TIMEOUT_MS;
+    if (up == member_up[i])
+      continue;
+
+    printf("Switch link %u is %s\n", i, up ? "up" : "down");
+    member_up[i] = up;
+    changed = 1;
+  }
+
+  if (changed)
+  {
+    rebuild_bonds();
+    refresh_all_routes();
+  }
+}
+
+
+//Copy out everything needed to forward unicast frames, for a data plane that runs outside switch_task()
+void switch_fwd_export(FWD_SNAPSHOT *snap)
+{
+  uint8_t i;
+
+  memset(snap, 0, sizeof(FWD_SNAPSHOT));
+  memcpy(snap->port, fwd_link, sizeof(snap->port));
+  memcpy(snap->bond_of, bond_of, sizeof(snap->bond_of));
+  snap->bond_mode = bond_mode;
+
+  for (i = 0; i < total_links; i++)
+  {
+    if (link_usable(i))
+      snap->members[bond_of[i]][snap->member_count[bond_of[i]]++] = i;
+    snap->fec[i] = links[i].fec_on;
+  }
+}
+
+
+/******************************/
+//Virtual output queues
+/******************************/
+
+//Frames forwarded to an egress link wait in a queue of their own per ingress link, so one chatty sender only fills
+//its own queue. Whenever the link's send queue runs dry, deficit round robin picks the next frame: each ingress gets
+//DRR_QUANTUM bytes per round, so big frames do not buy more than their share of the link.
+static VOQ voq[TOTAL_LINKS][TOTAL_LINKS];               //[egress][ingress]
+static uint16_t deficit[TOTAL_LINKS][TOTAL_LINKS];
+static uint8_t drr_next[TOTAL_LINKS];                   //Per egress: ingress queue being served
+static uint8_t drr_granted[TOTAL_LINKS];                //Per egress: whether it got its quantum this visit
+static uint8_t voq_pending[TOTAL_LINKS];                //Per egress: frames across all of its queues
+static unsigned long ingress_drops[TOTAL_LINKS];        //Frames from each ingress dropped for lack of room
+
+
+unsigned long switch_ingress_drops(uint8_t port)
+{
+  return (port < total_links) ? ingress_drops[port] : 0;
+}
+
+
+//Bytes of control frames the switch has queued on a port
+unsigned long switch_ctrl_bytes(uint8_t port)
+{
+  return (port < total_links) ? links[port].ctrl_bytes_sent : 0;
+}
+
+
+//Bytes of multicast frames the switch kept off a port, whose node is not in the group
+unsigned long switch_mcast_pruned(uint8_t port)
+{
+  return (port < total_links) ? links[port].mcast_bytes_pruned : 0;
+}
+
+
+uint8_t voq_enqueue(RAW_FRAME raw, uint8_t in, uint8_t e)
+{
+  VOQ *q = &voq[e][in];
+
+#ifdef SWITCH_FIFO_EGRESS
+  //Straight into the egress send queue, first come first served, as before the VOQs. Only there to measure what DRR
+  //changes (see the incast_bench host example)
+  if (!add_to_send_queue(raw, &links[e]))
+  {
+    ingress_drops[in]++;
+    return 0;
+  }
+  return 1;
+#endif
+
+  if (q->count == VOQ_DEPTH)
+  {
+    printf("VOQ %u->%u is full! Dropping...\n", in, e);
+    ingress_drops[in]++;
+    raw_release(raw);
+    return 0;
+  }
+
+  q->slot[(q->head + q->count) % VOQ_DEPTH] = raw;
+  q->count++;
+  voq_pending[e]++;
+
+  return 1;
+}
+
+
+//Move the next frame, in deficit round robin order, from the queues of egress e to its send queue
+uint8_t drr_dequeue(uint8_t e)
+{
+  uint8_t n, in;
+  VOQ *q;
+
+  //Two passes at most: every queue can be granted a quantum once, and the quantum always fits a frame
+  for (n = 0; n < 2 * total_links && voq_pending[e] > 0; n++)
+  {
+    in = drr_next[e];
+    q = &voq[e][in];
+
+    if (q->count > 0)
+    {
+      if (!drr_granted[e])
+      {
+        deficit[e][in] += DRR_QUANTUM;
+        drr_granted[e] = 1;
+      }
+
+      if (q->slot[q->head].size <= deficit[e][in])
+      {
+        deficit[e][in] -= q->slot[q->head].size;
+        add_to_send_queue(q->slot[q->head], &links[e]);
+        q->head = (q->head + 1) % VOQ_DEPTH;
+        q->count--;
+        voq_pending[e]--;
+        return 1;
+      }
+    }
+    else
+      deficit[e][in] = 0;   //An idle queue does not bank credit
+
+    drr_next[e] = (in + 1) % total_links;
+    drr_granted[e] = 0;
+  }
+
+  return 0;
+}
+
+
+//Drop every queued frame addressed to dst. Multicasts to the same-numbered group stay, as in purge_send_queue()
+uint8_t voq_purge(uint8_t dst)
+{
+  uint8_t e, in, i, kept, purged = 0;
+  VOQ *q;
+  RAW_FRAME raw;
+
+  for (e = 0; e < total_links; e++)
+  {
+    for (in = 0; in < total_links; in++)
+    {
+      q = &voq[e][in];
+
+      for (i = 0, kept = 0; i < q->count; i++)
+      {
+        raw = q->slot[(q->head + i) % VOQ_DEPTH];
+
+        if (((uint8_t)raw.buf[2] >> 4) == dst && *((uint16_t*)&raw.buf[0]) != GFRAME_PREAMBLE)
+        {
+          raw_release(raw);
+          purged++;
+        }
+        else
+          q->slot[(q->head + kept++) % VOQ_DEPTH] = raw;
+      }
+
+      voq_pending[e] -= q->count - kept;
+      q->count = kept;
+    }
+  }
+
+  return purged;
+}
+
 
 /******************************/
 //Active Monitoring
 /******************************/
 
+static volatile uint8_t pending_ticks = 0;       //Heartbeat ticks counted by the timer, not processed yet
+static unsigned long last_seen[MAX_ADDRESS + 1];  //millis() of the last frame from each id, to report detection latency
+
+
+//A node is gone: drop whatever is still queued for it, and send a LEAVE on its behalf out of every other port.
+//Neighbouring switches do the same when this LEAVE takes away their last route, so it spreads network-wide.
+void withdraw_node(uint8_t id, uint8_t reason, LINK *ingress)
+{
+  uint8_t i, purged = 0;
+
+  for (i = 0; i < total_links; i++)
+    purged += purge_send_queue(id, &links[i]);
+  purged += voq_purge(id);
+
+  if (purged)
+    printf("Purged %u queued frames for %u\n", purged, id);
+
+  for (i = 0; i < total_links; i++)
+  {
+    if (bond_of[i] != i || !link_usable(i) || (ingress != NULL && i == bond_of[ingress - links]))
+      continue;
+
+    send_leave_msg(id, reason, &links[bond_member(i, id, MAX_ADDRESS)]);
+  }
+}
+
+
 void check_alive(LINK *link)
 {
-  int i, j;
+  int j;
 
   //Loop through every routing table entry for each link. Skipping the 0th entry
   for (j = 1; j < RTABLE_LENGTH; j++)
   {
     //Increment the tick count on every live end node
-    if (link->rtable[j].hops == 1)
+    if (RT_HOPS(link, j) == 1)
     {
       //Increment the tick count for the current live node
-      ++link->rtable[j].ticks;
+      rt_add_tick(link, j);
 
       //Mark the node dead if tick threshold has been exceeded
-      if (link->rtable[j].ticks >= PING_TICKS_THRESHOLD)
+      if (RT_TICKS(link, j) >= PING_TICKS_THRESHOLD)
       {
-        link->rtable[j].hops = 0;
-        printf("ALERT: Node %d is declared dead!\n", j);
+        update_rtable_entry(j, 0, link);
+        refresh_route(j);
 
-        //Broadcast a LEAVE message if switch
+        //The node's group subscriptions died with it
+        if (link->end_link_type == ENDPOINT)
+          link->groups = 0;
+        printf("ALERT: Node %d is declared dead after %lu ms of silence!\n", j, millis() - last_seen[j]);
+
+        //Only withdraw the node if it is not still reachable over another link
+        if (best_link(j) == TOTAL_LINKS)
+          withdraw_node(j, TIMEOUT_LEAVE, NULL);
       }
 
       //Ping the node if missed ticks has exceeded to PING_TICKS
-      else if (link->rtable[j].ticks >= PING_TICKS)
+      else if (RT_TICKS(link, j) >= PING_TICKS)
       {
         printf("Checking if %d is alive\n", j);
         send_hello(0, j, link);
@@ -38,11 +526,27 @@ void check_alive(LINK *link)
   }
 }
 
+
+//Runs in interrupt context, so it only counts. The ticks are processed by process_ticks() from switch_task()
 void timer1_isr()
 {
-  int i;
-  for (i = 0; i < TOTAL_LINKS; i++)
-    check_alive(&links[i]);
+  if (pending_ticks < 0xFF)
+    pending_ticks++;
+}
+
+
+void process_ticks()
+{
+  uint8_t i, ticks;
+
+  noInterrupts();
+  ticks = pending_ticks;
+  pending_ticks = 0;
+  interrupts();
+
+  while (ticks--)
+    for (i = 0; i < total_links; i++)
+      check_alive(&links[i]);
 }
 
 
@@ -53,134 +557,311 @@ void timer1_isr()
 
 uint8_t create_send_cframe_switch(uint8_t src, uint8_t dst, uint8_t size, uchar *payload)
 {
-	int i;
-	
-	//Find which port is the dst reachable at
-  for (i = 0; i < TOTAL_LINKS; i++)
+  //Find which port is the dst reachable at
+  uint8_t i = best_link(dst);
+
+  if (i == TOTAL_LINKS)
   {
-    if (links[i].rtable[dst].hops > 0)
-      break;
-    else if (i == TOTAL_LINKS - 1)
-    {
-      printf("Could not locate node %d in any routing tables! Dropping...\n", dst);
-      return;
-    }
+    printf("Could not locate node %d in any routing tables! Dropping...\n", dst);
+    return 0;
   }
   
   //Send out the frame
-  create_send_cframe(src, dst, size, payload, &links[i]);
+  return create_send_cframe(src, dst, size, payload, &links[bond_member(i, src, dst)]);
 }
 
-uint8_t broadcast(FRAME frame)
+
+//Reverse path broadcast: accept a broadcast only from the link on our shortest path back to the sender, then flood it
+//to every other link. Copies that went around a loop arrive on some other link and are dropped, so each switch forwards
+//a broadcast exactly once, along the shortest path tree rooted at the sender.
+//Multicast frames follow the same tree, but endpoint ports only get a copy if their node subscribed to the group.
+//Links to other switches always get one, since group membership is not exchanged between switches.
+//The received raw frame is forwarded as is: every egress queue gets a reference to the same buffer, which is freed
+//once the last port has transmitted it. Takes ownership of raw.
+uint8_t broadcast(RAW_FRAME raw, LINK *ingress)
 {
-  uint8_t i, j;
+  uint8_t i;
+  uint8_t egress[TOTAL_LINKS];
   uint8_t sent_count = 0;
-  uchar* pl_orig = frame.payload;
+  uint16_t preamble = *((uint16_t*)&raw.buf[0]);
+  uint8_t src = (*((uint8_t*) &raw.buf[2])) & 0x0F;
+  uint8_t dst = ((*((uint8_t*) &raw.buf[2])) >> 4);
+  uint8_t rpf = best_link(src);
+  uint8_t in_port = bond_of[ingress - links];
 
-  //Loop through every link in the switch
-  for (i = 0; i < TOTAL_LINKS; i++)
+  //Unknown senders are only trusted when they are directly attached
+  if (rpf == TOTAL_LINKS ? ingress->end_link_type != ENDPOINT : rpf != in_port)
   {
-    //Do not forward if the other end of the link is uninitialized, or the other end of the link is only the sender
-    //if (links[i].end_link_type == UNKNOWN ||(links[i].rtable[frame.src].hops == 1 && links[i].rtable_entries == 1))
-    
-	//Do not forward if the other end of the link is uninitialized, or the other end of the link can reach the sender
-    if (links[i].end_link_type == UNKNOWN || links[i].rtable[frame.src].hops > 0)
+    printf("Bcast from %u arrived off the reverse path. Dropping...\n", src);
+    free(raw.buf);
+    return 0;
+  }
+
+  //Loop through every port in the switch. A bond gets a single copy, on one of its members
+  for (i = 0; i < total_links; i++)
+  {
+	//Do not forward if the other end of the link is uninitialized, or back to where it came from
+    if (bond_of[i] != i || !link_usable(i) || i == in_port)
       continue;
 
-    //printf("Link %d\n", i);
+    //Prune endpoints that did not subscribe to the group
+    if (preamble == GFRAME_PREAMBLE && links[i].end_link_type != GATEWAY && !(links[i].groups & GROUP_BIT(dst)))
+    {
+      links[i].mcast_bytes_pruned += raw.size;
+      continue;
+    }
 
-    //Make a new copy of the payload for each frame, since the transmitter will free them after transmission
-    frame.payload = malloc(frame.size);
-    memcpy(frame.payload, pl_orig, frame.size);
+    egress[sent_count++] = bond_member(i, src, dst);
+  }
 
-    //Change the destination to the current endpoint and transmit
-    send_frame(frame, &links[i]);
-    free(frame.payload);
-    ++sent_count;
+  if (sent_count == 0)
+  {
+    free(raw.buf);
+    return 0;
   }
 
-  //Assuming raw.buf is freed by the caller
+  //One buffer for all ports
+  raw_share(&raw, sent_count);
+  for (i = 0; i < sent_count; i++)
+    voq_enqueue(raw, ingress - links, egress[i]);
 
   return sent_count;
 }
 
 
-void reset_tick(uint8_t id)
+//Any frame from a directly attached node proves it alive on the link it arrived on
+void reset_tick(uint8_t id, LINK *link)
 {
-  int i;
+  if (id == 0 || id >= MAX_ADDRESS)
+    return;
+
+  last_seen[id] = millis();
+
+  if (RT_HOPS(link, id) == 1)
+    rt_reset_ticks(link, id);
+}
+
 
-  if (id == 0 || id == MAX_ADDRESS)
+//A frame from id was forwarded on our behalf. Counts as hearing from it, like proc_raw_frames() does
+void switch_note_heard(uint8_t id, uint8_t port)
+{
+  if (port >= total_links)
     return;
 
-  for (i = 0; i < TOTAL_LINKS; i++) {
-    if (links[i].rtable[id].hops > 0) {
-      links[i].rtable[id].ticks = 0;
-      break;
-    }
-  }
+  reset_tick(id, &links[port]);
+  last_heard[port] = millis();
+}
+
+
+/******************************/
+//Routing table versioning
+/******************************/
+
+static uint8_t rt_version = 0;                  //Version of the routing state across all links. 0 is never used
+static uint8_t rt_change_seq[RTABLE_LENGTH];    //Version at which each entry last changed
 
-  if (i == TOTAL_LINKS && links[i].rtable[id].hops == 0)
-    printf("ERROR: Could not find id %d\n", id);
+
+//Record that the route to id has changed. Deltas go out on the next switch_task() iteration
+void mark_route_changed(uint8_t id)
+{
+  fwd_lat_adv[id] = fwd_lat[id];
+
+  if (++rt_version == 0)
+    rt_version = 1;
+
+  rt_change_seq[id] = rt_version;
 }
 
 
-//Send rtable with entries from multiple links
-uint8_t send_rtbles_msg(uint8_t dst)
+//Send rtable with entries from multiple links. Each id is listed once, with its best hop count.
+uint8_t send_rtbles_msg(uint8_t dst, LINK *link)
 {
-	uint8_t i, j, writeidx;
+	uint8_t i, hops, writeidx;
 	uint8_t entries_added = 0;
 	uint8_t total_entries = 0;
-	uint8_t pl_size;
 	
 	//Calculate number of entries
-	for(i=0; i<TOTAL_LINKS; i++)
-		total_entries += links[i].rtable_entries;
+	for(i=1; i<RTABLE_LENGTH; i++)
+		if(route_hops(i) > 0)
+			total_entries++;
 	
-	//Calculate the Payload size
-	pl_size = LINK_MSG_SIZE + 1 + total_entries * NODE_LENGTH;
-	
-	//Buffer for preamble + entries
-	uchar msg[pl_size];		
+	//Buffer for preamble + entries + version
+	uchar msg[RTBLE_HEADER_SIZE + total_entries * NODE_LENGTH];		
 	
 	//Copy the preamble string to the payload
 	strncpy(msg, ROUTING_PREAMBLE, LINK_MSG_SIZE);
 	
-	//Append the number of routing entries that follows
-	msg[LINK_MSG_SIZE] = total_entries;
+	//Append the version the entries represent
+	msg[LINK_MSG_SIZE + 1] = rt_version;
 	
 	//Append each of the node information to the payload
-	for(i=0; i<TOTAL_LINKS; i++)
+	for(i=1; i<RTABLE_LENGTH; i++)
+	{
+		hops = route_hops(i);
+		if(hops == 0)
+			continue;
+		
+		//Increment the write index for the payload
+		writeidx = RTBLE_HEADER_SIZE + NODE_LENGTH*(entries_added++);
+		
+		//Write the ID, and the incremented hops
+		msg[writeidx] = i;
+		msg[writeidx + 1] = hops + 1;
+	}
+	
+	//Append the number of routing entries that follows
+	msg[LINK_MSG_SIZE] = entries_added;
+	
+	//Create and send out an "RTBLE" message
+	printf("Sending RTBLE v%d with %d entries to %d\n", rt_version, entries_added, dst);
+	create_send_cframe(0, dst, RTBLE_HEADER_SIZE + entries_added * NODE_LENGTH, msg, link);
+	link->rt_sent_version = rt_version;
+	
+	return 0;
+}
+
+
+//Advertise our distance vector to a neighbouring switch. Every id is listed so withdrawn routes are carried as well.
+//Each entry carries the hop count and our latency metric to the id.
+//Poison reverse: routes we reach through this very link are advertised as unreachable (0), so they never bounce back.
+uint8_t send_dvect_msg(LINK *link)
+{
+	uint8_t i, best, writeidx;
+	uint16_t lat;
+	uchar msg[DVECT_HEADER_SIZE + RTABLE_LENGTH * DVECT_ENTRY_LENGTH];
+	
+	strncpy(msg, DVECT_PREAMBLE, LINK_MSG_SIZE);
+	msg[LINK_MSG_SIZE] = RTABLE_LENGTH - 1;
+	
+	for(i=1; i<RTABLE_LENGTH; i++)
 	{
-		for(j=0; j<RTABLE_LENGTH; j++)
+		best = best_link(i);
+		writeidx = DVECT_HEADER_SIZE + DVECT_ENTRY_LENGTH*(i - 1);
+		
+		msg[writeidx] = i;
+		if(best == TOTAL_LINKS || best == bond_of[link - links] || route_hops(i) + 1 >= RT_INFINITY)
+		{
+			msg[writeidx + 1] = 0;
+			lat = RT_METRIC_UNREACHABLE;
+		}
+		else
 		{
-			if(links[i].rtable[j].hops > 0)
-			{
-				//Increment the write index for the payload
-				writeidx = LINK_MSG_SIZE + 1 + NODE_LENGTH*(entries_added++);
-				
-				//Write the ID
-				msg[writeidx] = (uint8_t)j;
-				
-				//Write and increment the hops
-				msg[writeidx + 1] = (uint8_t)(links[i].rtable[j].hops + 1);
-			}
+			msg[writeidx + 1] = route_hops(i) + 1;
+			lat = fwd_lat[i];
 		}
+		memcpy(&msg[writeidx + 2], &lat, 2);
 	}
 	
+	printf("Sending DVECT v%d\n", rt_version);
+	create_send_cframe(0, 0, DVECT_HEADER_SIZE + (RTABLE_LENGTH - 1) * DVECT_ENTRY_LENGTH, msg, link);
+	link->rt_sent_version = rt_version;
 	
-	printf("Written %d entries. Should be %d\n", entries_added, total_entries);
-	print_bytes(msg, pl_size);
-	printf("\n");
+	return 0;
+}
+
+
+//Merge a neighbouring switch's distance vector into the routing table of the link it arrived on
+uint8_t parse_dvect_msg(FRAME frame, LINK *link)
+{
+	uint8_t entries;
+	uint8_t i, curid, curhops, readidx;
+	uint8_t idx = link - links;
+	uint16_t curlat;
 	
+	if(link->end_link_type != GATEWAY || frame.size < DVECT_HEADER_SIZE)
+		return 0;
 	
-	//Create and send out an "RTBLE" message
-	printf("Sending RTBLE to %d\n", dst);
-	create_send_cframe_switch(0, dst, pl_size, msg);
+	//A corrupt count must not take the loop past the payload
+	entries = (uint8_t)frame.payload[LINK_MSG_SIZE];
+	entries = min(entries, (frame.size - DVECT_HEADER_SIZE) / DVECT_ENTRY_LENGTH);
+	
+	for(i=0; i<entries; i++)
+	{
+		readidx = DVECT_HEADER_SIZE + DVECT_ENTRY_LENGTH*i;
+		curid = (uint8_t)frame.payload[readidx];
+		curhops = (uint8_t)frame.payload[readidx + 1];
+		memcpy(&curlat, &frame.payload[readidx + 2], 2);
+		
+		if(curid == 0 || curid >= MAX_ADDRESS || (curhops == RT_HOPS(link, curid) && curlat == adv_lat[idx][curid]))
+			continue;
+		
+		adv_lat[idx][curid] = curlat;
+		
+		//Withdrawn or poisoned route
+		if(curhops == 0 || curhops >= RT_INFINITY)
+		{
+			if(RT_HOPS(link, curid) > 0)
+				update_rtable_entry(curid, 0, link);
+		}
+		else if(curhops != RT_HOPS(link, curid))
+			update_rtable_entry(curid, curhops, link);
+		
+		//Only a change in our best route is advertised further
+		refresh_route(curid);
+	}
+	
+	return 1;
+}
+
+
+//Send only the entries that changed since the version last acknowledged by the other end of the link
+uint8_t send_rtdlt_msg(LINK *link)
+{
+	uint8_t i, writeidx;
+	uint8_t entries_added = 0;
+	uint8_t from_version = link->rt_version;
+	uint8_t window = rt_version - from_version;
+	uchar msg[RTDLT_HEADER_SIZE + (RTABLE_LENGTH - 1) * NODE_LENGTH];		//Ids 1 to RTABLE_LENGTH - 1 at most
+	
+	strncpy(msg, RTDELTA_PREAMBLE, LINK_MSG_SIZE);
+	msg[LINK_MSG_SIZE + 1] = from_version;
+	msg[LINK_MSG_SIZE + 2] = rt_version;
+	
+	//An entry changed after from_version if it is closer to the current version. Entries that aliased
+	//after the version wrapped are sent again, which is harmless since deltas carry absolute values
+	for(i=1; i<RTABLE_LENGTH; i++)
+	{
+		if(rt_change_seq[i] == 0 || (uint8_t)(rt_version - rt_change_seq[i]) >= window)
+			continue;
+		
+		writeidx = RTDLT_HEADER_SIZE + NODE_LENGTH*(entries_added++);
+		msg[writeidx] = i;
+		msg[writeidx + 1] = route_hops(i) ? route_hops(i) + 1 : 0;
+	}
+	
+	msg[LINK_MSG_SIZE] = entries_added;
+	
+	printf("Sending RTDLT v%d->v%d with %d entries\n", from_version, rt_version, entries_added);
+	create_send_cframe(0, MAX_ADDRESS, RTDLT_HEADER_SIZE + entries_added * NODE_LENGTH, msg, link);
+	link->rt_sent_version = rt_version;
 	
 	return 0;
 }
 
 
+//Bring every initialized link up to the current routing version
+void sync_routes()
+{
+  uint8_t i;
+
+  for (i = 0; i < total_links; i++)
+  {
+    if (links[i].end_link_type == UNKNOWN || links[i].rt_sent_version == rt_version)
+      continue;
+
+    //Neighbouring switches always get our whole distance vector
+    if (links[i].end_link_type == GATEWAY)
+      send_dvect_msg(&links[i]);
+
+    //Fall back to a full table if the other end never synced, or is too far behind
+    else if (links[i].rt_version == 0 || (uint8_t)(rt_version - links[i].rt_version) >= RT_DELTA_WINDOW)
+      send_rtbles_msg(MAX_ADDRESS, &links[i]);
+    else
+      send_rtdlt_msg(&links[i]);
+  }
+}
+
+
 
 void proc_raw_frames(RAW_FRAME raw, LINK *link)
 {
@@ -188,11 +869,30 @@ void proc_raw_frames(RAW_FRAME raw, LINK *link)
   uint8_t src = (*((uint8_t*) &raw.buf[2])) & 0x0F;
   uint8_t dest = ((*((uint8_t*) &raw.buf[2])) >> 4);
   uint8_t i, retval;
+  LINK_TYPE end_type = link->end_link_type;
 
+  uint8_t reachable = best_link(src) != TOTAL_LINKS;
   FRAME frame;
 
-  //Reset the missed tick count for the sender
-  reset_tick(src);
+  //Reset the missed tick count for the sender, and the heartbeat of the link
+  reset_tick(src, link);
+  last_heard[link - links] = millis();
+
+  //A switch upstream gave up on this frame halfway through
+  if (RAW_ABORTED(raw))
+  {
+    printf("Aborted frame from %u. Dropping...\n", src);
+    free(raw.buf);
+    return;
+  }
+
+  //Handle multicast packets. dst is a group here, so this must be checked before anything addressed to the switch
+  if (preamble == GFRAME_PREAMBLE)
+  {
+    printf("Mcast from %u to group %u. ", src, dest);
+    printf("Forwarded to %u links\n", broadcast(raw, link));
+    return;
+  }
 
   //Is this packet intended for the switch itself?
   if (dest == 0 || preamble == CFRAME_PREAMBLE)
@@ -204,21 +904,57 @@ void proc_raw_frames(RAW_FRAME raw, LINK *link)
     //Handle the control frame
     retval = parse_control_frame(frame, link);
 
-    //Broadcast Join frames
+    //HELLO, JOIN and LEAVE may all have changed the sender's entry in this link's rtable
+    refresh_route(frame.src);
+
+    //Membership changes are propagated to the other links as routing deltas by sync_routes()
     if (retval == Join_Frame)
     {
-      //Reply the sender with a complete routing table
-	  send_rtbles_msg(frame.src);
-	  
-	  printf("Broadcasting JOIN frame to all other nodes\n");
-
-      //Add 1 to hops
-      int hops = *((uint8_t*)&frame.payload[LINK_MSG_SIZE]);
-      frame.dst = MAX_ADDRESS;
-      frame.payload[LINK_MSG_SIZE] = ++hops;
-      broadcast(frame);
+      //The joiner starts from scratch, so it gets a complete routing table
+      link->rt_version = 0;
+      mark_route_changed(frame.src);
+    }
+    else if (retval == Leave_Frame)
+    {
+      mark_route_changed(frame.src);
+
+      if (link->end_link_type == ENDPOINT)
+        link->groups = 0;
+
+      //Pass the LEAVE on only if it took away our last route, which also stops it from circling
+      if (reachable && best_link(frame.src) == TOTAL_LINKS)
+        withdraw_node(frame.src, (uint8_t)frame.payload[LINK_MSG_SIZE], link);
+    }
+
+    //Resend the complete routing table on request
+    else if (retval == Reqrt_Frame)
+    {
+      link->rt_version = 0;
+      send_rtbles_msg(frame.src, link);
     }
 
+    //Identify the switch at the other end, since links to the same switch are bonded
+    else if (retval == Hello_Frame && link->end_link_type == GATEWAY)
+    {
+      if (frame.size > LINK_MSG_SIZE + 1 && peer_nonce[link - links] != frame.payload[LINK_MSG_SIZE + 1])
+      {
+        peer_nonce[link - links] = frame.payload[LINK_MSG_SIZE + 1];
+        rebuild_bonds();
+        refresh_all_routes();
+      }
+
+      //A neighbouring switch just showed up. Give it our distance vector
+      if (end_type == UNKNOWN)
+        send_dvect_msg(link);
+    }
+
+    //Every HELLO may have moved this link's RTT, and with it the latency of every path through it
+    if (retval == Hello_Frame)
+      refresh_all_routes();
+
+    else if (retval == Dvect_Frame)
+      parse_dvect_msg(frame, link);
+
     free(frame.payload);
     return;
   }
@@ -226,35 +962,202 @@ void proc_raw_frames(RAW_FRAME raw, LINK *link)
   //Handle broadcast packets
   if (dest == MAX_ADDRESS)
   {
-    //Parse the raw frame
-    frame = raw_to_frame(raw);
-    free(raw.buf);
+    printf("Bcast from %u. ", src);
+    printf("Forwarded to %u links\n", broadcast(raw, link));
+    return;
+  }
 
-    printf("Bcast from %u. ", frame.src);
-    printf("Forwarded to %u links\n", broadcast(frame));
-    free(frame.payload);
+
+
+  //Find which port is the dst reachable at, along the shortest path
+  i = best_link(dest);
+
+  if (i == TOTAL_LINKS || i == bond_of[link - links])
+  {
+    printf("Could not locate node %d in any routing tables! Dropping...\n", dest);
+    free(raw.buf);
     return;
   }
 
+  //Forward the frame. A bonded port spreads it onto one of its members
+  i = bond_member(i, src, dest);
+  printf("src: %u, dst: %u, olnk: %u\n", src, dest, i);
+  voq_enqueue(raw, link - links, i);
 
+}
 
-  //Find which port is the dst reachable at
-  for (i = 0; i < TOTAL_LINKS; i++)
+
+/******************************/
+//Cut-through forwarding
+/******************************/
+
+//Unicast messages start going out on the egress port as soon as their header has arrived, instead of after the whole
+//frame is buffered. The final byte is held back until the frame is complete: it is the ETX if the frame arrived intact,
+//or ABORT otherwise. Anything else (control frames, broadcasts, a busy or slower egress port) is stored and forwarded.
+static uint8_t cut_through_on = 1;
+static unsigned long port_baud[TOTAL_LINKS];
+static uint8_t ct_egress[TOTAL_LINKS];          //Per ingress: link the current frame is cut through to, TOTAL_LINKS if none
+static uint8_t ct_feeding[TOTAL_LINKS];         //Per egress: ingress streaming into it, TOTAL_LINKS if none
+static size_t ct_sent[TOTAL_LINKS];             //Per ingress: bytes of the current frame already written out
+static unsigned long ct_progress[TOTAL_LINKS];  //Per ingress: millis() of the last byte streamed
+static uint8_t ct_held[TOTAL_LINKS];            //Per ingress: the frame at the head was aborted, store and forward it
+
+
+void switch_set_cut_through(uint8_t enable)
+{
+  cut_through_on = enable;
+}
+
+
+//Ask for FEC on a port. It can be set before switch_init_ports(), and applies from the port's next HELLO
+static uint8_t fec_wanted[TOTAL_LINKS];
+
+void switch_set_fec(uint8_t port, uint8_t enable)
+{
+  if (port >= TOTAL_LINKS)
+    return;
+
+  fec_wanted[port] = enable;
+  if (port < total_links)
+    link_set_fec(&links[port], enable);
+}
+
+
+//Egress link for the frame at the head of the ingress buffer, or TOTAL_LINKS if it has to be stored and forwarded
+uint8_t ct_select_egress(LINK *link)
+{
+  uint8_t in = link - links;
+  uchar *buf = link->recvbuf;
+  uint16_t preamble = *((uint16_t*)&buf[0]);
+  uint8_t src = buf[2] & 0x0F;
+  uint8_t dst = buf[2] >> 4;
+  uint8_t port, e;
+
+  if (preamble != MFRAME_PREAMBLE || dst == 0 || dst == MAX_ADDRESS || buf[FRAME_HEADER_SIZE] != STX)
+    return TOTAL_LINKS;
+
+  port = best_link(dst);
+  if (port == TOTAL_LINKS || port == bond_of[in])
+    return TOTAL_LINKS;
+
+  //The egress must be idle, and at least as fast as the ingress so it never runs ahead of the data
+  e = bond_member(port, src, dst);
+  if (links[e].squeue_pending > 0 || voq_pending[e] > 0 || ct_feeding[e] != TOTAL_LINKS || port_baud[e] < port_baud[in])
+    return TOTAL_LINKS;
+
+  //FEC encodes whole frames
+  if (links[e].fec_on)
+    return TOTAL_LINKS;
+
+  return e;
+}
+
+
+void ct_release(uint8_t in)
+{
+  ct_feeding[ct_egress[in]] = TOTAL_LINKS;
+  ct_egress[in] = TOTAL_LINKS;
+}
+
+
+//Give up on the frame being cut through. The receiver is still waiting for the rest of it, so pad it out to its
+//announced size and end it with ABORT. If the frame does complete later, it is stored and forwarded instead
+void ct_abort(uint8_t in, size_t expected)
+{
+  LINK *egress = &links[ct_egress[in]];
+
+  printf("Cut-through from link %u aborted\n", in);
+  for (; ct_sent[in] < expected - 1; ct_sent[in]++)
+    egress->port->write((uint8_t)0);
+  egress->port->write((uint8_t)ABORT);
+
+  ct_release(in);
+  ct_held[in] = 1;
+}
+
+
+//Stream whatever has arrived of the frame at the head of the ingress buffer, starting a cut-through if possible
+void cut_through(LINK *link)
+{
+  uint8_t in = link - links;
+  size_t expected, upto;
+
+  if (!link->rbuf_valid || link->rbuf_writeidx <= FRAME_HEADER_SIZE)
+    return;
+
+  expected = FRAME_HEADER_SIZE + link->recvbuf[3] + 2;
+
+  if (ct_egress[in] == TOTAL_LINKS)
   {
-    if (links[i].rtable[dest].hops > 0)
-      break;
-    else if (i == TOTAL_LINKS - 1)
-    {
-      printf("Could not locate node %d in any routing tables! Dropping...\n", dest);
-      free(raw.buf);
+    //A frame that is already complete goes out just as fast through the send queue
+    if (!cut_through_on || ct_held[in] || link->rbuf_writeidx >= expected)
       return;
-    }
+
+    ct_egress[in] = ct_select_egress(link);
+    if (ct_egress[in] == TOTAL_LINKS)
+      return;
+
+    ct_feeding[ct_egress[in]] = in;
+    ct_sent[in] = 0;
   }
 
-  //Forward the frame
-  printf("src: %u, dst: %u, olnk: %u\n", src, dest, i);
-  add_to_send_queue(raw, &links[i]);
+  //The receive buffer was flushed under us
+  if (link->rbuf_writeidx < ct_sent[in])
+  {
+    ct_abort(in, expected);
+    return;
+  }
 
+  //Everything but the last byte, which is only decided once the frame is complete
+  upto = min((size_t)link->rbuf_writeidx, expected - 1);
+  if (upto > ct_sent[in])
+  {
+    links[ct_egress[in]].port->write(&link->recvbuf[ct_sent[in]], upto - ct_sent[in]);
+    ct_sent[in] = upto;
+    ct_progress[in] = millis();
+  }
+}
+
+
+//The frame being cut through has fully arrived. Send the rest of it, ending it with ETX if it is intact
+void ct_finish(RAW_FRAME raw, LINK *link)
+{
+  uint8_t in = link - links;
+  LINK *egress = &links[ct_egress[in]];
+  uint8_t intact = raw.buf[FRAME_HEADER_SIZE] == STX && raw.buf[raw.size - 1] == ETX;
+
+  reset_tick(raw.buf[2] & 0x0F, link);
+  last_heard[in] = millis();
+
+  if (ct_sent[in] < raw.size - 1)
+    egress->port->write(&raw.buf[ct_sent[in]], raw.size - 1 - ct_sent[in]);
+  egress->port->write((uint8_t)(intact ? ETX : ABORT));
+
+  if (!intact)
+    printf("Corrupt frame cut through from link %u, aborted\n", in);
+
+  ct_release(in);
+  free(raw.buf);
+}
+
+
+//Abort cut-throughs whose ingress went quiet, so their egress port is not held forever
+uint8_t check_cut_through()
+{
+  uint8_t i, active = 0;
+
+  for (i = 0; i < total_links; i++)
+  {
+    if (ct_egress[i] == TOTAL_LINKS)
+      continue;
+
+    if (millis() - ct_progress[i] > CT_STALL_MS)
+      ct_abort(i, FRAME_HEADER_SIZE + links[i].recvbuf[3] + 2);
+    else
+      active = 1;
+  }
+
+  return active;
 }
 
 
@@ -271,15 +1174,23 @@ uint8_t read_serial_raw(LINK *link)
   if (!(bytes > 0 || link->rbuf_valid))
     return 0;
 
+  //Pass on whatever arrived of a frame being cut through
+  cut_through(link);
+
   //Extract frames from the raw receive buffer
   rawframe = extract_frame_from_rbuf(link);
   while (rawframe.size > 0)
   {
-    //Parse the frame and store it in the recvd buffer
-    proc_raw_frames(rawframe, link);
-
-    //Check if the rbuf contains more complete packets
+    //Parse the frame and store it in the recvd buffer, unless most of it has already been cut through
+    ct_held[link - links] = 0;
+    if (ct_egress[link - links] != TOTAL_LINKS)
+      ct_finish(rawframe, link);
+    else
+      proc_raw_frames(rawframe, link);
+
+    //Check if the rbuf contains more complete packets, or the start of one worth cutting through
     proc_buf(NULL, 0, link);
+    cut_through(link);
     rawframe = extract_frame_from_rbuf(link);
     frames_received++;
   }
@@ -299,27 +1210,65 @@ uint8_t read_serial_raw(LINK *link)
 /******************************/
 
 
-void switch_init()
+//Bring the switch up on the given ports. Each port must already be opened at its baud rate
+void switch_init_ports(const SWITCH_PORT *ports, uint8_t count)
 {
-  //Setup Timer
-  //Timer1.initialize(TICK_MS);
-  //Timer1.attachInterrupt(timer1_isr);
+  int i;
+
+  if (count > TOTAL_LINKS)
+  {
+    printf("ERROR: Only %d of %d ports can be used\n", TOTAL_LINKS, count);
+    count = TOTAL_LINKS;
+  }
 
-  //Initializing link layer data for serial1
-  Serial1.begin(115200);
-  Serial2.begin(115200);
-  Serial3.begin(115200);
+  total_links = count;
 
-  link_init(&Serial1, 0, GATEWAY, &links[0]);
-  link_init(&Serial2, 0, GATEWAY, &links[1]);
-  link_init(&Serial3, 0, GATEWAY, &links[2]);
-  
+  memset(fwd_link, TOTAL_LINKS, sizeof(fwd_link));
+  memset(fwd_hops, 0, sizeof(fwd_hops));
+  memset(fwd_lat, 0xFF, sizeof(fwd_lat));
+  memset(fwd_lat_adv, 0xFF, sizeof(fwd_lat_adv));
+
+  for (i = 0; i < TOTAL_LINKS; i++)
+  {
+    bond_of[i] = i;
+    ct_egress[i] = TOTAL_LINKS;
+    ct_feeding[i] = TOTAL_LINKS;
+  }
+
+  //Setup the heartbeat timer
+  Timer1.initialize(TICK_US);
+  Timer1.attachInterrupt(timer1_isr);
 
+  //Tag our HELLOs so a looped link can be recognized. Seeded from a floating pin so neighbouring switches differ
+  randomSeed(analogRead(NONCE_SEED_PIN));
+  hello_nonce = random(1, 256);
 
-  //Send out a HELLO message out onto the link
-  //send_hello(0, 0, &links[0]);
-  //send_hello(0, 0, &links[1]);      //TODO: Sometimes a link connected to an OFF device may lead to loopback. Handle this case.
-  //send_hello(0, 0, &links[2]);
+  for (i = 0; i < total_links; i++)
+  {
+    port_baud[i] = ports[i].baud;
+    link_init(ports[i].port, 0, GATEWAY, &links[i]);
+    link_set_fec(&links[i], fec_wanted[i]);
+
+    //Send out a HELLO message out onto the link. Neighbouring switches are discovered this way, and looped links ignore themselves
+    send_hello(0, 0, &links[i]);
+  }
+}
+
+
+//The Mega's three hardware serial ports
+void switch_init()
+{
+  static const SWITCH_PORT mega_ports[] = {
+    {&Serial1, SWITCH_LINK_BAUD},
+    {&Serial2, SWITCH_LINK_BAUD},
+    {&Serial3, SWITCH_LINK_BAUD},
+  };
+
+  Serial1.begin(SWITCH_LINK_BAUD);
+  Serial2.begin(SWITCH_LINK_BAUD);
+  Serial3.begin(SWITCH_LINK_BAUD);
+
+  switch_init_ports(mega_ports, sizeof(mega_ports) / sizeof(mega_ports[0]));
 }
 
 
@@ -330,16 +1279,30 @@ void switch_task(uint8_t continuous)
   while (1)
   {
     //Process one serial port at a time
-    for (i = 0; i < TOTAL_LINKS; i++)
+    for (i = 0; i < total_links; i++)
     {
       //Check if current serial port has any new frames ready for reading
       read_serial_raw(&links[i]);
 
-      //Transmit a packet in the sending queue, if any
-      transmit_next(&links[i]);
+      //Transmit a packet in the sending queue, if any. Not while a frame is being cut through onto this link.
+      //Forwarded frames are only scheduled in once the send queue is empty, so the fair share is decided late
+      if (ct_feeding[i] == TOTAL_LINKS)
+      {
+        if (links[i].squeue_pending == 0)
+          drr_dequeue(i);
+
+        transmit_next(&links[i]);
+      }
     }
 
-    delay(100);
+    //Catch up on heartbeat ticks, heartbeat the links to other switches, then send out routing deltas for any changes seen this iteration
+    process_ticks();
+    check_members();
+    sync_routes();
+
+    //Do not slow down a frame being cut through
+    if (!check_cut_through())
+      delay(SWITCH_LOOP_DELAY_MS);
 
     //Only run 1 iteration of send/receive if not in continuous mode
     if (!continuous) break;
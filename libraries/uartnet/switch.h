@@ -9,14 +9,73 @@
 
 
 //Link Layer Configuration
-#define TOTAL_LINKS         3
+#ifndef TOTAL_LINKS
+#define TOTAL_LINKS         3           //Port capacity. The ports in use come from a runtime table, and TOTAL_LINKS doubles as "no port"
+#endif
 #define SEND_QUEUE_SIZE     6
 #define RECV_BUFFER_SIZE    2*(MAX_PAYLOAD_SIZE + 16)     //add extra bytes for headers and other
 #define FLUSH_THRESHOLD     RECV_BUFFER_SIZE * 0.5
 
+//Link aggregation between switches
+#define BOND_FLOW_HASH      0           //Spread flows across members by src/dst, keeping each flow in order
+#define BOND_ROUND_ROBIN    1           //Spread every frame across members, for bulk traffic that tolerates reordering
+#define GATEWAY_HELLO_MS    3000        //Heartbeat interval on switch-to-switch links
+#define GATEWAY_TIMEOUT_MS  (3 * GATEWAY_HELLO_MS)
+
+//Virtual output queues. Forwarded frames wait per (egress, ingress) pair, and are drained by deficit round robin
+#define VOQ_DEPTH           3
+#define DRR_QUANTUM         FEC_WIRE_MAX    //Bytes per round. One largest frame as sent with FEC, so every round sends
+
+typedef struct {
+  RAW_FRAME slot[VOQ_DEPTH];
+  uint8_t head;
+  uint8_t count;
+} VOQ;
+
+//Pause between switch_task() iterations. A host switch, where nothing else shares the CPU, can go much lower
+#ifndef SWITCH_LOOP_DELAY_MS
+#define SWITCH_LOOP_DELAY_MS 100
+#endif
+
+//Cut-through forwarding
+#define SWITCH_LINK_BAUD    115200
+#define CT_STALL_MS         20          //A frame being cut through that stalls this long is aborted downstream
+
+//Unconnected analog pin used to seed the HELLO loopback nonce
+#define NONCE_SEED_PIN      A15
+
+
+//One entry of the port table. Any Stream will do: hardware or software serial, USB-serial, or a virtual port
+typedef struct {
+  Stream *port;
+  unsigned long baud;       //Used to decide whether frames can be cut through between two ports
+} SWITCH_PORT;
+
+
+//Forwarding state for a data plane running outside switch_task(), e.g. on other threads of a host switch
+typedef struct {
+  uint8_t port[MAX_ADDRESS + 1];                //Egress port per destination, TOTAL_LINKS if unreachable
+  uint8_t bond_of[TOTAL_LINKS];
+  uint8_t members[TOTAL_LINKS][TOTAL_LINKS];    //Usable members of each port
+  uint8_t member_count[TOTAL_LINKS];
+  uint8_t bond_mode;
+  uint8_t fec[TOTAL_LINKS];                     //Ports whose frames go out with FEC
+} FWD_SNAPSHOT;
+
 
 void switch_init();
+void switch_init_ports(const SWITCH_PORT *ports, uint8_t count);
 void switch_task(uint8_t continuous);
+void switch_set_bond_mode(uint8_t mode);
+void switch_set_cut_through(uint8_t enable);
+void switch_set_fec(uint8_t port, uint8_t enable);
+unsigned long switch_ingress_drops(uint8_t port);
+unsigned long switch_ctrl_bytes(uint8_t port);
+unsigned long switch_mcast_pruned(uint8_t port);
+
+//For an external data plane: copy out the forwarding state, and report frames it forwarded without switch_task()
+void switch_fwd_export(FWD_SNAPSHOT *snap);
+void switch_note_heard(uint8_t id, uint8_t port);
 
 
 #endif
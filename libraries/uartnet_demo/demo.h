@@ -0,0 +1,33 @@
+#ifndef _UARTNET_DEMOH_
+#define _UARTNET_DEMOH_
+
+#include "Arduino.h"
+#include <Servo.h>
+
+#include <frame.h>
+#include <link.h>
+
+
+//State shared by the LED cycler and the servo control. The sketch owns one and hands it to the frame handlers as ctx
+typedef struct {
+
+	LINK *link;
+	uint8_t my_id;
+
+	//LED cycler
+	uint8_t led_on;
+	uint8_t led_intensity;
+	uint8_t msg_src;				//Our neighbours on the ring the !TLED goes around
+	uint8_t msg_dst;
+	unsigned long led_start;		//When the pending !TLED was scheduled, 0 = none
+
+	//Servo control
+	Servo servo;
+	uint8_t servo_pos;				//Where the servo was last moved to
+	uint8_t joy_pos;				//Joystick readings last multicast (master only)
+	uint8_t joy_inten;
+
+} DEMO;
+
+
+#endif
@@ -1,10 +1,7 @@
 #ifndef _UARTNET_LEDCYCLE_DEMOH_
 #define _UARTNET_LEDCYCLE_DEMOH_
 
-#include "Arduino.h"
-
-#include <frame.h>
-#include <link.h>
+#include "demo.h"
 
 //GPIOs
 #define ACTIVITY_LED_PIN  13		//Not used
@@ -14,9 +11,9 @@
 #define LED_INIT_DELAY 3000
 #define LED_PERIOD 2000
 
-void led_cycler_init(uint8_t id, LINK *my_link);
-void send_led_msg(int8_t tosend);
-int8_t led_peer_update();
-void toggle_led();
+void led_cycler_init(DEMO *demo, uint8_t id, LINK *my_link);
+void send_led_msg(DEMO *demo, int8_t tosend);
+int8_t led_peer_update(DEMO *demo);
+void toggle_led(DEMO *demo);
 
 #endif
\ No newline at end of file
@@ -1,33 +1,21 @@
 #include "servo_ctrl.h"
-
-//Declared in led_cycler.cpp, only needed for dynamic brightness
-extern uint8_t led_intensity;
-extern uint8_t led_on;
-#define DEMO_LED_PIN    12
-
-static LINK *link;
-static Servo servo;
+#include "led_cycler.h"			//Only needed for dynamic brightness
 
 //Used by workers and master
-void move_servo(uint8_t servo_pos)
+void move_servo(DEMO *demo, uint8_t servo_pos)
 {
-  static uint8_t last_pos = 0;
-
   if (servo_pos > 180 || servo_pos < 0)  return;
 
-  if (last_pos == servo_pos) return;
+  if (demo->servo_pos == servo_pos) return;
 
   //Moves the servo to the new position
-  last_pos = servo_pos;
-  servo.write(servo_pos);
+  demo->servo_pos = servo_pos;
+  demo->servo.write(servo_pos);
 }
 
 //Used by master only
-void joystick_servo()
+void joystick_servo(DEMO *demo)
 {
-  static uint8_t last_pos = 90;            //Keeps track of the POS from the previous iteration
-  static uint8_t last_inten = 128;
-
   uint8_t servo_pos;
   uint8_t led_inten;
   uchar msg[7] = "!MVSV";
@@ -39,26 +27,26 @@ void joystick_servo()
   led_inten = map(analogRead(JOYSTICK_Y_PIN), 0, 1023, 0, 255);
 
   //No need to send POS/Intensity if either hasn't changed
-  if (servo_pos != last_pos)
-    last_pos = servo_pos;
-  else if (led_inten != last_inten)
-    last_inten = led_inten;
-  else if (servo_pos == last_pos && led_inten == last_inten)
+  if (servo_pos != demo->joy_pos)
+    demo->joy_pos = servo_pos;
+  else if (led_inten != demo->joy_inten)
+    demo->joy_inten = led_inten;
+  else if (servo_pos == demo->joy_pos && led_inten == demo->joy_inten)
     return;
 
-  //Broadcast the new POS
+  //Multicast the new POS to the nodes that follow it
 
   //strncpy(msg, "!MVSV", 5);
   msg[5] = (uchar)servo_pos;
   msg[6] = (uchar)led_inten;
-  create_send_frame(link->id, MAX_ADDRESS, 7, msg, link);
+  create_send_gframe(demo->link->id, MVSV_GROUP, 7, msg, demo->link);
 
   //Update local devices
-  move_servo(servo_pos);
-  led_intensity = led_inten;
+  move_servo(demo, servo_pos);
+  demo->led_intensity = led_inten;
 
-  if(led_on)
-    analogWrite(DEMO_LED_PIN, led_intensity);
+  if(demo->led_on)
+    analogWrite(DEMO_LED_PIN, demo->led_intensity);
 
   /*
     printf("Servo pos: %u\n", servo_pos);
@@ -69,7 +57,7 @@ void joystick_servo()
 
 }
 
-void parse_mvsv_cmd(FRAME frame)
+void parse_mvsv_cmd(DEMO *demo, FRAME frame)
 {
 	uint8_t pos = 90, inten = 128;
   
@@ -83,18 +71,21 @@ void parse_mvsv_cmd(FRAME frame)
     inten = *((uint8_t*) &frame.payload[6]);
 
     //Update local devices
-    move_servo(pos);
-    led_intensity = inten;
+    move_servo(demo, pos);
+    demo->led_intensity = inten;
     
-    if(led_on)  
-      analogWrite(DEMO_LED_PIN, led_intensity);
+    if(demo->led_on)  
+      analogWrite(DEMO_LED_PIN, demo->led_intensity);
 }
 
 
-void servo_ctrl_init(LINK *my_link)
+void servo_ctrl_init(DEMO *demo, LINK *my_link)
 {
-	link = my_link;
-	servo.attach(SERVO_PIN);            //Initialize Servos
+	demo->link = my_link;
+	demo->servo_pos = 0;
+	demo->joy_pos = 90;
+	demo->joy_inten = 128;
+	demo->servo.attach(SERVO_PIN);      //Initialize Servos
 }
 
 
@@ -1,11 +1,7 @@
 #ifndef _UARTNET_SERVOCTRL_DEMOH_
 #define _UARTNET_SERVOCTRL_DEMOH_
 
-#include "Arduino.h"
-#include <Servo.h>
-
-#include <frame.h>
-#include <link.h>
+#include "demo.h"
 
 
 //GPIOs
@@ -13,18 +9,21 @@
 #define JOYSTICK_Y_PIN  A1
 #define SERVO_PIN       2
 
+//Multicast group the !MVSV commands go to. Only nodes with a servo need to join it
+#define MVSV_GROUP      1
+
 //Common
-void servo_ctrl_init(LINK *my_link);
-void move_servo(uint8_t servo_pos);
+void servo_ctrl_init(DEMO *demo, LINK *my_link);
+void move_servo(DEMO *demo, uint8_t servo_pos);
 
 
 //For master only
-void joystick_servo();
-		
+void joystick_servo(DEMO *demo);
+
 
 //For slave only
-void parse_mvsv_cmd(FRAME frame);
-			
+void parse_mvsv_cmd(DEMO *demo, FRAME frame);
+
 
 
 
@@ -0,0 +1,152 @@
+#include "bench_pair.h"
+
+#include <shm_link.h>
+#include <noisy_stream.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+
+BENCH_NODE bench_nodes[2];
+volatile uint8_t bench_running = 1;
+
+//lines[0]/[1] are the two ends of node 1's line, lines[2]/[3] of node 2's. Every end writes through its noisy twin
+static ShmLink lines[4];
+static NoisyStream noisy[4];
+static char line_names[2][SHM_LINK_NAME_SIZE];
+static uint8_t lines_made = 0;
+static pthread_t threads[2];
+
+
+static unsigned long long now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+uint8_t bench_hops(const char *arg)
+{
+  uint8_t hops = atoi(arg);
+
+  return (hops == 1 || hops == 2) ? hops : 0;
+}
+
+
+uint8_t bench_start(const char *name, uint8_t hops, double ber, uint8_t fec, void* (*body)(void*))
+{
+  SWITCH_PORT ports[2];
+  uint8_t i;
+
+  for (i = 0; i < 4; i++)
+    noisy[i] = NoisyStream(&lines[i], ber, getpid() + i);
+
+  for (lines_made = 0; lines_made < hops; lines_made++)
+  {
+    snprintf(line_names[lines_made], SHM_LINK_NAME_SIZE, "/%s_%d_%d", name, getpid(), lines_made);
+    if (!lines[2 * lines_made].create(line_names[lines_made], RS_LINK_BAUD) ||
+        !lines[2 * lines_made + 1].attach(line_names[lines_made], RS_LINK_BAUD))
+      return 0;
+  }
+
+  //Only the nodes ask for FEC. The switch takes it up as soon as it sees their HELLOs
+  if (hops == 2)
+  {
+    ports[0].port = &noisy[0];
+    ports[1].port = &noisy[2];
+    ports[0].baud = ports[1].baud = RS_LINK_BAUD;
+    if (!host_switch_start(ports, 2, 2))
+      return 0;
+
+    bench_nodes[0].port = &noisy[1];
+    bench_nodes[1].port = &noisy[3];
+  }
+  else
+  {
+    bench_nodes[0].port = &noisy[0];
+    bench_nodes[1].port = &noisy[1];
+  }
+
+  for (i = 0; i < 2; i++)
+  {
+    bench_nodes[i].id = i + 1;
+    link_init(bench_nodes[i].port, bench_nodes[i].id, ENDPOINT, &bench_nodes[i].link);
+    link_set_fec(&bench_nodes[i].link, fec);
+    transport_initialize(&bench_nodes[i].tr, bench_nodes[i].id, &bench_nodes[i].link);
+    send_hello(bench_nodes[i].id, 0, &bench_nodes[i].link);
+    send_join_msg(bench_nodes[i].id, &bench_nodes[i].link);
+  }
+
+  for (i = 0; i < 2; i++)
+    pthread_create(&threads[i], NULL, body, &bench_nodes[i]);
+
+  return 1;
+}
+
+
+void bench_set_ber(double ber)
+{
+  uint8_t i;
+
+  for (i = 0; i < 4; i++)
+    noisy[i].set_ber(ber);
+}
+
+
+unsigned long bench_bits_flipped()
+{
+  unsigned long flipped = 0;
+  uint8_t i;
+
+  for (i = 0; i < 4; i++)
+    flipped += noisy[i].bits_flipped();
+
+  return flipped;
+}
+
+
+void bench_poll(BENCH_NODE *node)
+{
+  unsigned long long start = now_ns();
+  uint8_t taken;
+
+  taken = transport_check_recv(&node->tr);
+  if (taken > 0)
+  {
+    node->pump_ns += now_ns() - start;
+    node->frames_pumped += taken;
+  }
+
+  if (millis() - node->last_hello >= BENCH_HELLO_MS)
+  {
+    node->last_hello = millis();
+    send_hello(node->id, 0, &node->link);
+  }
+
+  transport_task(&node->tr);
+  while (transmit_next(&node->link));
+  usleep(BENCH_POLL_US);
+}
+
+
+void bench_stop()
+{
+  bench_running = 0;
+  pthread_join(threads[0], NULL);
+  pthread_join(threads[1], NULL);
+}
+
+
+void bench_exit()
+{
+  uint8_t i;
+
+  fflush(stderr);
+  for (i = 0; i < lines_made; i++)
+    shm_unlink(line_names[i]);
+
+  _exit(0);
+}
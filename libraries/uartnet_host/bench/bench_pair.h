@@ -0,0 +1,56 @@
+/*Fixture shared by the transport benches: node 1 and node 2, each with a link and a transport on top, over one hop (a
+direct line) or two (through a host switch, one thread group per port). Every line runs at RS_LINK_BAUD over shared
+memory, and flips bits at the set rate in both directions.
+
+A bench hands bench_start() a thread body, run once per node, that loops on bench_poll() while bench_running and adds
+its own traffic. bench_stop() ends the threads, and bench_exit() the process.
+
+Build the benches with the transport layer on top of the host switch build: -Iuartnet_transport_layer
+-Iuartnet_host/bench, and all .c and .cpp files in uartnet_transport_layer and uartnet_host/bench.*/
+
+#ifndef _UARTNET_HOST_BENCH_PAIRH_
+#define _UARTNET_HOST_BENCH_PAIRH_
+
+#include <host_switch.h>
+#include <transport.h>
+
+#define BENCH_HELLO_MS			1000
+#define BENCH_POLL_US			200			//Pause between passes of a node's loop
+
+
+typedef struct {
+  Stream *port;
+  uint8_t id;
+  LINK link;
+  TRANSPORT tr;
+  unsigned long last_hello;
+
+  //What the receive pump cost, for the benches that report it
+  unsigned long frames_pumped;
+  unsigned long long pump_ns;
+} BENCH_NODE;
+
+extern BENCH_NODE bench_nodes[2];
+extern volatile uint8_t bench_running;
+
+
+//The <hops> argument: 1 or 2, and 0 for anything else
+uint8_t bench_hops(const char *arg);
+
+//Sets up the lines, the switch if any and both nodes, asking for FEC if fec is set, then runs body(&bench_nodes[i])
+//on a thread per node. name tags the lines. Returns 0 on failure
+uint8_t bench_start(const char *name, uint8_t hops, double ber, uint8_t fec, void* (*body)(void*));
+void bench_set_ber(double ber);
+unsigned long bench_bits_flipped();
+
+//One pass of a node's main loop: the receive pump, HELLOs, the transport's timers and the link's send queue
+void bench_poll(BENCH_NODE *node);
+
+void bench_stop();
+
+//Prints nothing more, and does not return. The switch's threads never stop, and would still be using the lines if
+//exit() unmapped them, so only their names go
+void bench_exit();
+
+
+#endif
@@ -0,0 +1,190 @@
+#include "bench_star.h"
+
+#include <shm_link.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+
+STAR_NODE star_nodes[STAR_MAX_NODES];
+uint8_t star_total = 0;
+volatile uint8_t star_running = 1;
+uint8_t star_own_joins = 0;
+
+static ShmLink sw_lines[STAR_MAX_NODES];
+static ShmLink node_lines[STAR_MAX_NODES];
+static char line_names[STAR_MAX_NODES][SHM_LINK_NAME_SIZE];
+static uint8_t lines_made = 0;
+static SWITCH_PORT ports[STAR_MAX_NODES];
+static pthread_t sw_thread, nodes_thread;
+static void (*star_traffic)(STAR_NODE*) = NULL;
+static void (*star_on_frame)(STAR_NODE*, FRAME*) = NULL;
+
+
+uint8_t star_count(const char *arg)
+{
+  int nodes = atoi(arg);
+
+  return (nodes >= 2 && nodes <= STAR_MAX_NODES) ? nodes : 0;
+}
+
+
+static void* switch_thread(void*)
+{
+  switch_init_ports(ports, star_total);
+  switch_set_cut_through(0);
+
+  while (star_running)
+    switch_task(0);
+
+  return NULL;
+}
+
+
+static void* node_thread(void*)
+{
+  STAR_NODE *node;
+  FRAME frame;
+  uint8_t i, busy;
+
+  while (star_running)
+  {
+    busy = 0;
+
+    for (i = 0; i < star_total; i++)
+    {
+      node = &star_nodes[i];
+
+      if (!node->up)
+      {
+        if (star_traffic != NULL)
+          star_traffic(node);
+        continue;
+      }
+
+      if (read_serial(&node->link) > 0)
+      {
+        while (node->link.rqueue_pending > 0)
+        {
+          frame = pop_recv_queue(&node->link);
+
+          if (frame.src == 0 || frame.preamble == CFRAME_PREAMBLE)
+            parse_control_frame(frame, &node->link);
+          else if (star_on_frame != NULL)
+            star_on_frame(node, &frame);
+
+          free(frame.payload);
+        }
+        busy = 1;
+      }
+
+      if (millis() - node->last_hello >= STAR_HELLO_MS)
+      {
+        node->last_hello = millis();
+        send_hello(node->id, 0, &node->link);
+      }
+
+      if (star_traffic != NULL)
+        star_traffic(node);
+
+      while (transmit_next(&node->link))
+        busy = 1;
+    }
+
+    if (!busy)
+      usleep(STAR_IDLE_US);
+  }
+
+  return NULL;
+}
+
+
+uint8_t star_start(const char *name, uint8_t nodes, unsigned long baud, void (*traffic)(STAR_NODE*),
+                   void (*on_frame)(STAR_NODE*, FRAME*))
+{
+  STAR_NODE *node;
+  uint8_t i;
+
+  star_traffic = traffic;
+  star_on_frame = on_frame;
+
+  for (lines_made = 0; lines_made < nodes; lines_made++)
+  {
+    snprintf(line_names[lines_made], SHM_LINK_NAME_SIZE, "/%s_%d_%d", name, getpid(), lines_made);
+    if (!sw_lines[lines_made].create(line_names[lines_made], baud) || !node_lines[lines_made].attach(line_names[lines_made]))
+      return 0;
+
+    ports[lines_made].port = &sw_lines[lines_made];
+    ports[lines_made].baud = baud ? baud : SWITCH_LINK_BAUD;
+  }
+
+  star_total = nodes;
+  for (i = 0; i < star_total; i++)
+  {
+    node = &star_nodes[i];
+    node->id = i + 1;
+    node->last_hello = millis();
+    link_init(&node_lines[i], node->id, ENDPOINT, &node->link);
+    node->up = 0;
+
+    if (!star_own_joins)
+    {
+      send_hello(node->id, 0, &node->link);
+      send_join_msg(node->id, &node->link);
+      node->up = 1;
+    }
+  }
+
+  if (pthread_create(&sw_thread, NULL, switch_thread, NULL) != 0 ||
+      pthread_create(&nodes_thread, NULL, node_thread, NULL) != 0)
+    return 0;
+
+  return 1;
+}
+
+
+void star_join(STAR_NODE *node)
+{
+  uchar msg[LINK_MSG_SIZE + 1];
+
+  memcpy(msg, JOIN_PREAMBLE, LINK_MSG_SIZE);
+  msg[LINK_MSG_SIZE] = 0x01;
+
+  node->last_hello = millis();
+  send_hello(node->id, 0, &node->link);
+  create_send_cframe(node->id, 0, sizeof(msg), msg, &node->link);
+  node->up = 1;
+}
+
+
+unsigned long long star_switch_ns()
+{
+  struct timespec ts;
+  clockid_t clock;
+
+  if (pthread_getcpuclockid(sw_thread, &clock) != 0 || clock_gettime(clock, &ts) != 0)
+    return 0;
+
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+void star_stop()
+{
+  star_running = 0;
+  pthread_join(nodes_thread, NULL);
+  pthread_join(sw_thread, NULL);
+}
+
+
+void star_exit()
+{
+  uint8_t i;
+
+  fflush(stderr);
+  for (i = 0; i < lines_made; i++)
+    shm_unlink(line_names[i]);
+
+  _exit(0);
+}
@@ -0,0 +1,61 @@
+/*Fixture shared by the switch benches: the switch core (switch.cpp) with one node on each of its ports, all on shared
+memory lines. The switch runs switch_task() on a thread of its own, with cut-through off, and the nodes all share a
+second thread. The switch's CPU time per frame can then be read off its thread, however many cores there are.
+
+The switch writes to the lines at the baud rate given, or as fast as the rings go with 0. The nodes always write
+unthrottled: a throttled write blocks until the line has room, and would hold up every other node on the thread.
+
+A bench hands star_start() a traffic function and a frame handler, either may be NULL. On every pass each node reads
+its line, answers control frames and hands the rest to the handler, sends its HELLOs, calls the traffic function to
+queue its own frames, then transmits. Every node joins at once when star_start() is called. A bench that sets
+star_own_joins brings each node up itself with star_join() instead, and until then only the traffic function is called
+for it. star_stop() ends both threads, and star_exit() the process.
+
+Build the benches like the transport benches (see bench_pair.h). -DTOTAL_LINKS=32 gives the switch its full port
+count, and -DSWITCH_LOOP_DELAY_MS=0 keeps its loop from sleeping.*/
+
+#ifndef _UARTNET_HOST_BENCH_STARH_
+#define _UARTNET_HOST_BENCH_STARH_
+
+#include <switch.h>
+#include <routing.h>
+
+#define STAR_MAX_NODES			(MAX_ADDRESS - 1 < TOTAL_LINKS ? MAX_ADDRESS - 1 : TOTAL_LINKS)
+#define STAR_HELLO_MS			1000
+#define STAR_IDLE_US			200			//Pause of the node thread after a pass with nothing to do
+
+
+typedef struct {
+  uint8_t id;								//Node i + 1 is on port i
+  LINK link;
+  unsigned long last_hello;
+  uint8_t up;								//Whether it has sent its HELLO and JOIN
+} STAR_NODE;
+
+extern STAR_NODE star_nodes[STAR_MAX_NODES];
+extern uint8_t star_total;
+extern volatile uint8_t star_running;
+extern uint8_t star_own_joins;
+
+
+//The <nodes> argument: 2 to STAR_MAX_NODES, and 0 for anything else
+uint8_t star_count(const char *arg);
+
+//Sets up the lines, the switch and the nodes, then starts both threads. name tags the lines. Returns 0 on failure
+uint8_t star_start(const char *name, uint8_t nodes, unsigned long baud, void (*traffic)(STAR_NODE*),
+                   void (*on_frame)(STAR_NODE*, FRAME*));
+
+//Sends the node's first HELLO and its JOIN, the JOIN without the random wait send_join_msg() takes, which would hold
+//up every node on the thread. Call it from the traffic function
+void star_join(STAR_NODE *node);
+
+//CPU time the switch thread has used so far
+unsigned long long star_switch_ns();
+
+void star_stop();
+
+//Prints nothing more, and does not return. Only the lines' names go, like bench_exit()
+void star_exit();
+
+
+#endif
@@ -0,0 +1,58 @@
+/*Minimal stand-in for the Arduino core, so the uartnet libraries also build on a Linux host.
+Put this directory first on the include path, and build with -fpermissive like the Arduino IDE does.*/
+
+#ifndef _UARTNET_HOST_ARDUINOH_
+#define _UARTNET_HOST_ARDUINOH_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH				1
+#define LOW					0
+#define INPUT				0
+#define OUTPUT				1
+
+//Analog pins as numbered on the Mega
+#define A0					54
+#define A1					55
+#define A15					69
+
+#ifndef min
+#define min(a, b)			((a) < (b) ? (a) : (b))
+#define max(a, b)			((a) > (b) ? (a) : (b))
+#endif
+#define constrain(x, lo, hi)	((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+
+
+//Time since the process started
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+//There are no pins on a host. Analog reads return noise, so anything seeded from a floating pin still differs per process
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+//"Interrupts" are the TimerOne thread. Masking them holds it off
+void noInterrupts();
+void interrupts();
+
+
+#include "HardwareSerial.h"
+
+#endif
@@ -0,0 +1,28 @@
+/*The Mega's serial ports do not exist on a host. These objects only let Mega-specific code build: they never receive
+anything, and discard what is written to them. Host programs hand real ports to the libraries as Streams instead.*/
+
+#ifndef _UARTNET_HOST_HARDWARESERIALH_
+#define _UARTNET_HOST_HARDWARESERIALH_
+
+#include "Stream.h"
+
+
+class HardwareSerial : public Stream
+{
+  public:
+    void begin(unsigned long) {}
+    void end() {}
+
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+
+    using Print::write;
+    size_t write(uint8_t) { return 1; }
+    size_t write(const uint8_t*, size_t size) { return size; }
+};
+
+extern HardwareSerial Serial, Serial1, Serial2, Serial3;
+
+
+#endif
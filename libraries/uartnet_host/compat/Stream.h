@@ -0,0 +1,60 @@
+/*Host version of Arduino's Print and Stream. Only what the uartnet libraries use.
+Unlike Arduino, readBytes() is virtual and never waits, so a port can serve it with a single system call.*/
+
+#ifndef _UARTNET_HOST_STREAMH_
+#define _UARTNET_HOST_STREAMH_
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+      size_t n = 0;
+
+      while (size-- && write(*buffer++))
+        n++;
+
+      return n;
+    }
+
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+
+    virtual int availableForWrite() { return 0; }
+};
+
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    //Reads what is already there, up to length bytes
+    virtual size_t readBytes(char *buffer, size_t length)
+    {
+      size_t n = 0;
+      int c;
+
+      while (n < length && (c = read()) >= 0)
+        buffer[n++] = (char)c;
+
+      return n;
+    }
+
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char*)buffer, length); }
+
+    //Descriptor that turns readable when data arrives, for epoll. -1 if the stream has to be polled
+    virtual int fd() { return -1; }
+};
+
+
+#endif
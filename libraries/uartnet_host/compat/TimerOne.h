@@ -0,0 +1,31 @@
+/*Host version of the TimerOne library. The "interrupt" runs on its own thread, with interrupts masked
+(see noInterrupts()) while the callback runs, so code sharing state with it works unchanged.*/
+
+#ifndef _UARTNET_HOST_TIMERONEH_
+#define _UARTNET_HOST_TIMERONEH_
+
+#include <pthread.h>
+
+
+class TimerOne
+{
+  public:
+    void initialize(unsigned long microseconds = 1000000);
+    void attachInterrupt(void (*isr)());
+    void attachInterrupt(void (*isr)(), unsigned long microseconds);
+    void detachInterrupt();
+    void setPeriod(unsigned long microseconds) { period = microseconds; }
+
+  private:
+    static void* run(void *arg);
+
+    unsigned long period;
+    void (*volatile callback)();
+    pthread_t thread;
+    bool started;
+};
+
+extern TimerOne Timer1;
+
+
+#endif
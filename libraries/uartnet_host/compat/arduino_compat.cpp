@@ -0,0 +1,168 @@
+#include "Arduino.h"
+#include "TimerOne.h"
+
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+HardwareSerial Serial, Serial1, Serial2, Serial3;
+TimerOne Timer1;
+
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/******************************/
+//Time
+/******************************/
+
+static uint64_t now_us()
+{
+  static uint64_t start = 0;
+  struct timespec ts;
+  uint64_t t;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  t = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+  if (start == 0)
+    start = t;
+
+  return t - start;
+}
+
+
+unsigned long millis()
+{
+  return now_us() / 1000;
+}
+
+
+unsigned long micros()
+{
+  return now_us();
+}
+
+
+void delay(unsigned long ms)
+{
+  usleep(ms * 1000);
+}
+
+
+void delayMicroseconds(unsigned int us)
+{
+  usleep(us);
+}
+
+
+/******************************/
+//Math
+/******************************/
+
+long random(long howbig)
+{
+  return (howbig == 0) ? 0 : ::random() % howbig;
+}
+
+
+long random(long howsmall, long howbig)
+{
+  if (howsmall >= howbig)
+    return howsmall;
+
+  return howsmall + random(howbig - howsmall);
+}
+
+
+void randomSeed(unsigned long seed)
+{
+  if (seed != 0)
+    srandom(seed);
+}
+
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+
+/******************************/
+//Pins
+/******************************/
+
+int analogRead(uint8_t)
+{
+  return (getpid() ^ micros()) & 0x3FF;
+}
+
+void analogWrite(uint8_t, int) {}
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return LOW; }
+
+
+/******************************/
+//Interrupts and TimerOne
+/******************************/
+
+void noInterrupts()
+{
+  pthread_mutex_lock(&irq_lock);
+}
+
+
+void interrupts()
+{
+  pthread_mutex_unlock(&irq_lock);
+}
+
+
+void TimerOne::initialize(unsigned long microseconds)
+{
+  period = microseconds;
+}
+
+
+void TimerOne::attachInterrupt(void (*isr)(), unsigned long microseconds)
+{
+  period = microseconds;
+  attachInterrupt(isr);
+}
+
+
+void TimerOne::attachInterrupt(void (*isr)())
+{
+  callback = isr;
+
+  if (!started)
+    started = pthread_create(&thread, NULL, run, this) == 0;
+}
+
+
+void TimerOne::detachInterrupt()
+{
+  callback = NULL;
+}
+
+
+void* TimerOne::run(void *arg)
+{
+  TimerOne *timer = (TimerOne*)arg;
+  void (*isr)();
+
+  while (1)
+  {
+    usleep(timer->period);
+
+    isr = timer->callback;
+    if (isr == NULL)
+      continue;
+
+    noInterrupts();
+    isr();
+    interrupts();
+  }
+
+  return NULL;
+}
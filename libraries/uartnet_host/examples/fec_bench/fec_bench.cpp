@@ -0,0 +1,169 @@
+/*What forward error correction buys against line noise. Node 1 talks to node 2 over one hop (a direct line) or two
+(through a host switch), set up by the bench pair (see bench_pair.h). The lines are clean while the nodes join and
+negotiate FEC, then flip bits at the given rate for two phases of the given length each:
+  - single-frame messages at a steady pace, for the residual frame loss: sent frames that never arrived intact
+  - back to back reliable streams, for the goodput left once retransmissions are paid for
+  fec_bench <hops> <bit error rate> <fec: 0 or 1> [seconds] [frame bytes]
+Build it with e.g. -DFEC_PARITY=8 or -DFEC_BLOCK_SIZE=32 to try other codes.
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <bench_pair.h>
+
+#include <unistd.h>
+
+#define BENCH_WARMUP_MS			3000		//Clean lines while the nodes join and swap HELLOs
+#define BENCH_FRAME_MS			30			//Gap between single-frame messages, a little over a FEC frame's time on the line
+#define BENCH_STREAM_SIZE		16384
+
+
+enum {PHASE_WARMUP = 0, PHASE_FRAMES, PHASE_STREAMS, PHASE_DONE};
+
+static volatile uint8_t phase = PHASE_WARMUP;
+static uchar *frame_data, *stream_data;
+static uint8_t frame_size = 200;
+
+//Results
+static unsigned long frames_sent = 0, frames_ok = 0, frames_corrupt = 0, frames_stray = 0;	//Stray: deliveries of no size sent
+static unsigned long streams_ok = 0, streams_corrupt = 0;
+
+
+void sender(BENCH_NODE *node)
+{
+  unsigned long last_frame = 0;
+  uint8_t state;
+
+  while (bench_running)
+  {
+    bench_poll(node);
+
+    if (phase == PHASE_FRAMES && millis() - last_frame >= BENCH_FRAME_MS)
+    {
+      last_frame = millis();
+      if (send_umpacket(create_umpacket(node->id, 2, frame_size, frame_data), &node->link))
+        frames_sent++;
+    }
+
+    if (phase == PHASE_STREAMS)
+    {
+      state = transport_stream_state(&node->tr, 2);
+      if (state != CONN_SYN_SENT && state != CONN_OPEN)
+        transport_send_stream(&node->tr, 2, stream_data, BENCH_STREAM_SIZE);
+    }
+  }
+}
+
+
+void receiver(BENCH_NODE *node)
+{
+  RECVD_DATA recvd;
+
+  while (bench_running)
+  {
+    bench_poll(node);
+
+    while (transport_recv(&node->tr, &recvd))
+    {
+      if (recvd.data.message.size == frame_size)
+      {
+        if (memcmp(recvd.data.message.payload, frame_data, frame_size) == 0)
+          frames_ok++;
+        else
+          frames_corrupt++;
+      }
+      else if (phase == PHASE_STREAMS)
+      {
+        if (recvd.data.message.size == BENCH_STREAM_SIZE &&
+            memcmp(recvd.data.message.payload, stream_data, BENCH_STREAM_SIZE) == 0)
+          streams_ok++;
+        else
+          streams_corrupt++;
+      }
+      else
+        frames_stray++;
+
+      transport_free(&recvd);
+    }
+  }
+}
+
+
+void* node_thread(void *arg)
+{
+  BENCH_NODE *node = (BENCH_NODE*)arg;
+
+  if (node->id == 1)
+    sender(node);
+  else
+    receiver(node);
+
+  return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+  uint8_t hops, fec, i;
+  unsigned long seconds = 20, corrected = 0, failed = 0, lost, partial = 0;
+  CONNECTION *conn = &bench_nodes[1].tr.in_streams[1];
+  double ber;
+
+  if (argc < 4 || !(hops = bench_hops(argv[1])))
+  {
+    fprintf(stderr, "usage: %s <hops: 1 or 2> <bit error rate> <fec: 0 or 1> [seconds] [frame bytes]\n", argv[0]);
+    return 1;
+  }
+
+  ber = atof(argv[2]);
+  fec = atoi(argv[3]);
+  if (argc > 4)
+    seconds = strtoul(argv[4], NULL, 10);
+  if (argc > 5)
+    frame_size = constrain(strtoul(argv[5], NULL, 10), 1UL, (unsigned long)UMPACKET_MAX_PAYLOAD);
+
+  srandom(getpid());
+  frame_data = (uchar*)malloc(frame_size);
+  stream_data = (uchar*)malloc(BENCH_STREAM_SIZE);
+  for (i = 0; i < frame_size; i++)
+    frame_data[i] = random();
+  for (uint32_t j = 0; j < BENCH_STREAM_SIZE; j++)
+    stream_data[j] = random();
+
+  if (!bench_start("fec_bench", hops, 0, fec, node_thread))
+    return 1;
+
+  usleep(BENCH_WARMUP_MS * 1000UL);
+  bench_set_ber(ber);
+
+  phase = PHASE_FRAMES;
+  sleep(seconds);
+  phase = PHASE_STREAMS;
+  usleep(500000);			//Stragglers of the first phase
+  sleep(seconds);
+  phase = PHASE_DONE;
+
+  //Whole streams alone would make for a coarse figure on a bad line
+  if (conn->state == CONN_OPEN)
+    partial = conn->last_ack;
+
+  bench_stop();
+
+  for (i = 0; i < 2; i++)
+  {
+    corrected += bench_nodes[i].link.fec_corrected;
+    failed += bench_nodes[i].link.fec_failed;
+  }
+
+  lost = frames_sent - min(frames_ok, frames_sent);
+  fprintf(stderr, "%d hop(s), BER %g, FEC %s (nodes %s): %lu bits flipped, %lu bytes corrected at the nodes, "
+          "%lu frames beyond repair\n", hops, ber, fec ? "on" : "off",
+          (bench_nodes[0].link.fec_on && bench_nodes[1].link.fec_on) ? "sending with it" : "not sending with it",
+          bench_bits_flipped(), corrected, failed);
+  fprintf(stderr, "  frames: %lu sent, %lu intact, %lu corrupt, %lu stray; residual loss %.2f%%, goodput %lu B/s\n",
+          frames_sent, frames_ok, frames_corrupt, frames_stray, frames_sent ? 100.0 * lost / frames_sent : 0.0,
+          frames_ok * frame_size / seconds);
+  fprintf(stderr, "  streams: %lu intact, %lu corrupt; goodput %lu B/s, %lu bytes resent of %lu sent, %lu timeouts\n",
+          streams_ok, streams_corrupt, (streams_ok * BENCH_STREAM_SIZE + partial) / seconds,
+          bench_nodes[0].tr.rs_bytes_resent, bench_nodes[0].tr.rs_bytes_sent, bench_nodes[0].tr.rs_timeouts);
+
+  bench_exit();
+}
@@ -0,0 +1,75 @@
+/*Forwarding rate of the switch core. Every node floods unicast frames to the next one through a switch with a port
+each (see bench_star.h), over unthrottled lines, so the switch is never waiting on a line.
+  fwd_bench <nodes> <seconds> [payload bytes]
+Build it with -DTOTAL_LINKS=32 -DSWITCH_LOOP_DELAY_MS=0, then a second time adding -DSWITCH_FWD_SCAN, which looks
+routes up by scanning every link as the switch did before its forwarding table. Frames per second depend on how many
+cores the node thread and the switch get; the switch's CPU time per frame does not.
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <bench_star.h>
+
+#include <unistd.h>
+
+#define BENCH_WARMUP_MS			2000		//Time for the nodes to join before the flood starts
+
+static volatile uint8_t measuring = 0;
+static unsigned long received = 0;
+static uchar payload[MAX_PAYLOAD_SIZE];
+static uint8_t payload_size = 16;
+
+
+//Keep every send queue topped up, each node to the next
+void traffic(STAR_NODE *node)
+{
+  if (millis() < BENCH_WARMUP_MS || node->link.squeue_pending > 0)
+    return;
+
+  create_send_frame(node->id, node->id % star_total + 1, payload_size, payload, &node->link);
+}
+
+
+void on_frame(STAR_NODE *node, FRAME *frame)
+{
+  if (measuring && frame->dst == node->id)
+    received++;
+}
+
+
+int main(int argc, char **argv)
+{
+  uint8_t nodes;
+  unsigned long seconds;
+  unsigned long long switch_ns;
+
+  if (argc < 3 || !(nodes = star_count(argv[1])))
+  {
+    fprintf(stderr, "usage: %s <nodes: 2 to %d> <seconds> [payload bytes]\n", argv[0], STAR_MAX_NODES);
+    return 1;
+  }
+
+  seconds = max(strtoul(argv[2], NULL, 10), 1UL);
+  if (argc > 3)
+    payload_size = constrain(strtoul(argv[3], NULL, 10), 1UL, (unsigned long)MAX_PAYLOAD_SIZE);
+  memset(payload, 0x5A, sizeof(payload));
+
+  if (!star_start("fwd_bench", nodes, 0, traffic, on_frame))
+    return 1;
+
+  usleep((BENCH_WARMUP_MS + 1000) * 1000UL);
+  switch_ns = star_switch_ns();
+  measuring = 1;
+  sleep(seconds);
+  measuring = 0;
+  switch_ns = star_switch_ns() - switch_ns;
+  star_stop();
+
+#ifdef SWITCH_FWD_SCAN
+  fprintf(stderr, "Per-lookup scan of %d links, ", TOTAL_LINKS);
+#else
+  fprintf(stderr, "Forwarding table, %d links, ", TOTAL_LINKS);
+#endif
+  fprintf(stderr, "%d nodes, %d byte payloads: %lu frames/s, %llu ns of switch CPU per frame\n", nodes, payload_size,
+          received / seconds, received ? switch_ns / received : 0);
+
+  star_exit();
+}
@@ -0,0 +1,79 @@
+/*Runs a host switch over the ports given on the command line, and prints per-port counters every second.
+  host_switch <groups> /dev/ttyUSB0 shm:node1 shm:node2@115200 ...
+groups is the number of RX/TX thread pairs, 0 for one pair per port. shm:NAME creates a shared-memory line for a node
+process to attach to, unthrottled unless a baud rate follows the name.*/
+
+#include <host_switch.h>
+#include <shm_link.h>
+
+#include <unistd.h>
+
+static SerialPort streams[TOTAL_LINKS];
+static ShmLink shm_streams[TOTAL_LINKS];
+
+
+int main(int argc, char **argv)
+{
+  SWITCH_PORT ports[TOTAL_LINKS];
+  HOST_PORT_STATS st;
+  uint8_t count = 0, groups, i;
+  unsigned long baud;
+  char *at;
+
+  if (argc < 3)
+  {
+    fprintf(stderr, "usage: %s <groups> <tty | shm:name[@baud]>...\n", argv[0]);
+    return 1;
+  }
+
+  for (i = 2; i < argc && count < TOTAL_LINKS; i++)
+  {
+    if (strncmp(argv[i], "shm:", 4) == 0)
+    {
+      at = strchr(argv[i], '@');
+      baud = 0;
+      if (at != NULL)
+      {
+        *at = '\0';
+        baud = strtoul(at + 1, NULL, 10);
+      }
+
+      //Shared memory names start with a slash
+      argv[i][3] = '/';
+      if (!shm_streams[count].create(argv[i] + 3, baud))
+        return 1;
+
+      ports[count].port = &shm_streams[count];
+    }
+    else
+    {
+      if (!streams[count].open(argv[i], SWITCH_LINK_BAUD))
+        return 1;
+
+      ports[count].port = &streams[count];
+    }
+
+    ports[count].baud = SWITCH_LINK_BAUD;
+    count++;
+  }
+
+  groups = host_switch_start(ports, count, atoi(argv[1]));
+  if (groups == 0)
+    return 1;
+
+  fprintf(stderr, "Switching %d ports on %d thread groups\n", count, groups);
+
+  while (1)
+  {
+    sleep(1);
+
+    for (i = 0; i < count; i++)
+    {
+      host_switch_stats(i, &st);
+      fprintf(stderr, "port %2d: rx %lu fwd %lu tx %lu (%lu bytes) drops %lu\n", i, st.rx_frames, st.fwd_frames,
+              st.tx_frames, st.tx_bytes, st.drops);
+    }
+  }
+
+  return 0;
+}
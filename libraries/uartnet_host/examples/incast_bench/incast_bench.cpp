@@ -0,0 +1,92 @@
+/*Many-to-one fairness of the switch core. Every node but node 1 floods unicast frames to node 1 through a switch with a
+port each (see bench_star.h), so node 1's line is the bottleneck. Node 2 sends full frames and the others small ones,
+and each ingress's share of node 1's line is reported, with Jain's index over those shares (1 is a fair split).
+  incast_bench <nodes> <seconds> [small payload bytes]
+Build it with -DTOTAL_LINKS=32, then a second time adding -DSWITCH_FIFO_EGRESS, which queues frames straight onto the
+egress link in arrival order, as the switch did before its VOQs. The switch writes at SWITCH_LINK_BAUD.
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <bench_star.h>
+
+#include <unistd.h>
+
+#define BENCH_WARMUP_MS			2000		//Time for the nodes to join before the flood starts
+
+static volatile uint8_t measuring = 0;
+static unsigned long frames[STAR_MAX_NODES + 1];		//Per source id
+static unsigned long bytes[STAR_MAX_NODES + 1];
+static uchar payload[MAX_PAYLOAD_SIZE];
+static uint8_t small_size = 16;
+
+
+//Keep every sender's queue topped up. Node 2 is the big sender
+void traffic(STAR_NODE *node)
+{
+  if (millis() < BENCH_WARMUP_MS || node->id == 1 || node->link.squeue_pending > 0)
+    return;
+
+  create_send_frame(node->id, 1, node->id == 2 ? MAX_PAYLOAD_SIZE : small_size, payload, &node->link);
+}
+
+
+//Bytes as they went over node 1's line
+void on_frame(STAR_NODE *node, FRAME *frame)
+{
+  if (!measuring || node->id != 1 || frame->src < 2 || frame->src > star_total)
+    return;
+
+  frames[frame->src]++;
+  bytes[frame->src] += FRAME_HEADER_SIZE + frame->size + 2;
+}
+
+
+int main(int argc, char **argv)
+{
+  uint8_t nodes, i;
+  unsigned long seconds, total = 0;
+  double share, sum = 0, sum_sq = 0;
+
+  if (argc < 3 || !(nodes = star_count(argv[1])) || nodes < 3)
+  {
+    fprintf(stderr, "usage: %s <nodes: 3 to %d> <seconds> [small payload bytes]\n", argv[0], STAR_MAX_NODES);
+    return 1;
+  }
+
+  seconds = max(strtoul(argv[2], NULL, 10), 1UL);
+  if (argc > 3)
+    small_size = constrain(strtoul(argv[3], NULL, 10), 1UL, (unsigned long)MAX_PAYLOAD_SIZE);
+  memset(payload, 0x5A, sizeof(payload));
+
+  if (!star_start("incast_bench", nodes, SWITCH_LINK_BAUD, traffic, on_frame))
+    return 1;
+
+  usleep((BENCH_WARMUP_MS + 1000) * 1000UL);
+  measuring = 1;
+  sleep(seconds);
+  measuring = 0;
+  star_stop();
+
+  for (i = 2; i <= nodes; i++)
+    total += bytes[i];
+
+#ifdef SWITCH_FIFO_EGRESS
+  fprintf(stderr, "FIFO egress, ");
+#else
+  fprintf(stderr, "VOQs with DRR, ");
+#endif
+  fprintf(stderr, "%d senders into node 1 at %lu baud, node 2 sends %d byte payloads, the others %d:\n", nodes - 1,
+          (unsigned long)SWITCH_LINK_BAUD, MAX_PAYLOAD_SIZE, small_size);
+
+  for (i = 2; i <= nodes; i++)
+  {
+    share = total ? 100.0 * bytes[i] / total : 0;
+    sum += share;
+    sum_sq += share * share;
+    fprintf(stderr, "  node %2d: %6lu frames/s %7lu B/s %5.1f%% of the line, %lu dropped at the switch\n", i,
+            frames[i] / seconds, bytes[i] / seconds, share, switch_ingress_drops(i - 1));
+  }
+
+  fprintf(stderr, "Jain's index over the shares: %.3f\n", sum_sq > 0 ? sum * sum / ((nodes - 1) * sum_sq) : 0);
+
+  star_exit();
+}
@@ -0,0 +1,96 @@
+/*Control traffic of a join storm: the nodes on a switch with a port each (see bench_star.h) all power up at once, and
+each sends its HELLO and JOIN after the random wait of up to JOIN_JITTER_MS that send_join_msg() takes. The bench
+reports how long it takes until every node's routing table holds all the others, and how many bytes of control frames
+the switch sent over the lines by then and in the whole run.
+  joinstorm_bench <nodes> [seconds]
+Build it with -DTOTAL_LINKS=32, then a second time adding -DRT_DELTA_WINDOW=0, which has the switch send every node
+its full table whenever the routes change, as it did before RTDLT. The switch writes at SWITCH_LINK_BAUD. rand() is
+left unseeded, so both builds see the same join times.
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <bench_star.h>
+
+#include <unistd.h>
+
+#define JOIN_JITTER_MS			3000		//As in send_join_msg()
+
+static unsigned long started;
+static unsigned long join_at[STAR_MAX_NODES];			//Per node: when it comes up
+static uint8_t synced[STAR_MAX_NODES];				//Per node: whether its table has held every other node
+static uint8_t synced_count = 0;
+static unsigned long converged_at = 0;
+static unsigned long converged_bytes = 0;
+
+
+//No traffic of its own: each node comes up when its time comes, and its table is checked on every pass
+void traffic(STAR_NODE *node)
+{
+  uint8_t i = node->id - 1;
+
+  if (!node->up)
+  {
+    if (millis() - started >= join_at[i])
+      star_join(node);
+    return;
+  }
+
+  if (synced[i] || rtable_count(&node->link) < star_total - 1)
+    return;
+
+  synced[i] = 1;
+  if (++synced_count < star_total)
+    return;
+
+  //The switch thread is still running, so this is as close as it gets to the moment of convergence
+  for (i = 0; i < star_total; i++)
+    converged_bytes += switch_ctrl_bytes(i);
+  converged_at = millis();
+}
+
+
+int main(int argc, char **argv)
+{
+  uint8_t nodes, i;
+  unsigned long seconds = 8, total = 0;
+
+  if (argc < 2 || !(nodes = star_count(argv[1])))
+  {
+    fprintf(stderr, "usage: %s <nodes: 2 to %d> [seconds]\n", argv[0], STAR_MAX_NODES);
+    return 1;
+  }
+
+  if (argc > 2)
+    seconds = max(strtoul(argv[2], NULL, 10), 1UL);
+
+  for (i = 0; i < nodes; i++)
+    join_at[i] = rand() % JOIN_JITTER_MS;
+
+  star_own_joins = 1;
+  started = millis();
+  if (!star_start("joinstorm_bench", nodes, SWITCH_LINK_BAUD, traffic, NULL))
+    return 1;
+
+  sleep(seconds);
+  star_stop();
+
+  for (i = 0; i < nodes; i++)
+    total += switch_ctrl_bytes(i);
+
+#if RT_DELTA_WINDOW == 0
+  fprintf(stderr, "Full tables only, ");
+#else
+  fprintf(stderr, "Deltas within %d versions, ", RT_DELTA_WINDOW);
+#endif
+  fprintf(stderr, "%d nodes joining within %d ms:\n", nodes, JOIN_JITTER_MS);
+
+  if (converged_at)
+    fprintf(stderr, "  every table complete after %lu ms, %lu bytes of control frames from the switch by then\n",
+            converged_at - started, converged_bytes);
+  else
+    fprintf(stderr, "  %d of %d tables complete after %lu s\n", synced_count, nodes, seconds);
+
+  fprintf(stderr, "  %lu bytes of control frames from the switch in %lu s, %lu per node\n", total, seconds,
+          total / nodes);
+
+  star_exit();
+}
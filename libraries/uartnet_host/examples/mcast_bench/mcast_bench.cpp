@@ -0,0 +1,129 @@
+/*Bandwidth multicast saves over broadcast. Node 1 of a switch with a port each (see bench_star.h) sends the same frames
+twice, first as broadcasts to every node, then as multicasts to a group only some of the nodes joined. The bench counts
+the bytes of those frames arriving on every node's line, members and the rest apart, and reports what multicast saved,
+next to the bytes the switch itself counts as pruned.
+  mcast_bench <nodes> <members> [frames] [payload bytes]
+Build it with -DTOTAL_LINKS=32. The lines are unthrottled, and node 1 sends a frame every MCAST_GAP_MS so the switch
+drops none; the frames received are printed to show it.
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <bench_star.h>
+
+#include <unistd.h>
+
+#define MCAST_GROUP				1
+#define MCAST_GAP_MS			4			//Between node 1's frames. At 1 ms the switch drops some broadcasts
+#define BENCH_WARMUP_MS			1000		//Time for the nodes to join before the first phase
+#define BENCH_DRAIN_MS			500			//Time for the last frames of a phase to arrive
+
+enum { PHASE_IDLE, PHASE_BCAST, PHASE_MCAST };
+
+static volatile uint8_t phase = PHASE_IDLE;
+static volatile unsigned long sent = 0;
+static unsigned long last_sent = 0;
+static uint8_t members = 0;
+static unsigned long to_send = 500;
+static uchar payload[MAX_PAYLOAD_SIZE];
+static uint8_t payload_size = 64;
+
+//Per phase, [0] for the nodes outside the group and [1] for the members
+static unsigned long rx_frames[3][2];
+static unsigned long rx_bytes[3][2];
+
+
+//Nodes 2 to members + 1 join the group. Node 1 sends to everyone, or to the group, depending on the phase
+void traffic(STAR_NODE *node)
+{
+  if (!node->up)
+  {
+    star_join(node);
+    if (node->id >= 2 && node->id <= members + 1)
+      send_group_msg(node->id, MCAST_GROUP, 1, &node->link);
+    return;
+  }
+
+  if (node->id != 1 || phase == PHASE_IDLE || sent >= to_send || millis() - last_sent < MCAST_GAP_MS)
+    return;
+
+  if (phase == PHASE_BCAST)
+    create_send_frame(1, MAX_ADDRESS, payload_size, payload, &node->link);
+  else
+    create_send_gframe(1, MCAST_GROUP, payload_size, payload, &node->link);
+
+  last_sent = millis();
+  sent++;
+}
+
+
+//Bytes as they went over the receiving node's line
+void on_frame(STAR_NODE *node, FRAME *frame)
+{
+  uint8_t member = node->id >= 2 && node->id <= members + 1;
+
+  if (frame->src != 1 || phase == PHASE_IDLE)
+    return;
+
+  rx_frames[phase][member]++;
+  rx_bytes[phase][member] += FRAME_HEADER_SIZE + frame->size + 2;
+}
+
+
+//Send a phase's frames and wait for them to arrive
+void run_phase(uint8_t p)
+{
+  sent = 0;
+  phase = p;
+
+  while (sent < to_send)
+    usleep(10000);
+
+  usleep(BENCH_DRAIN_MS * 1000UL);
+}
+
+
+int main(int argc, char **argv)
+{
+  uint8_t nodes, p, i;
+  unsigned long bcast, mcast, saved, pruned = 0;
+  const char *names[3] = {"", "Broadcast", "Multicast"};
+
+  if (argc < 3 || !(nodes = star_count(argv[1])) || (members = atoi(argv[2])) > nodes - 1)
+  {
+    fprintf(stderr, "usage: %s <nodes: 2 to %d> <members: 0 to nodes - 1> [frames] [payload bytes]\n", argv[0],
+            STAR_MAX_NODES);
+    return 1;
+  }
+
+  if (argc > 3)
+    to_send = max(strtoul(argv[3], NULL, 10), 1UL);
+  if (argc > 4)
+    payload_size = constrain(strtoul(argv[4], NULL, 10), 1UL, (unsigned long)MAX_PAYLOAD_SIZE);
+  memset(payload, 0x5A, sizeof(payload));
+
+  star_own_joins = 1;
+  if (!star_start("mcast_bench", nodes, 0, traffic, on_frame))
+    return 1;
+
+  usleep(BENCH_WARMUP_MS * 1000UL);
+  run_phase(PHASE_BCAST);
+  run_phase(PHASE_MCAST);
+  star_stop();
+
+  for (i = 0; i < nodes; i++)
+    pruned += switch_mcast_pruned(i);
+
+  fprintf(stderr, "%lu frames of %d byte payloads from node 1, %d of the other %d nodes in the group:\n", to_send,
+          payload_size, members, nodes - 1);
+
+  for (p = PHASE_BCAST; p <= PHASE_MCAST; p++)
+    fprintf(stderr, "  %s: members got %lu frames, %lu bytes; the rest got %lu frames, %lu bytes\n", names[p],
+            rx_frames[p][1], rx_bytes[p][1], rx_frames[p][0], rx_bytes[p][0]);
+
+  bcast = rx_bytes[PHASE_BCAST][0] + rx_bytes[PHASE_BCAST][1];
+  mcast = rx_bytes[PHASE_MCAST][0] + rx_bytes[PHASE_MCAST][1];
+  saved = bcast > mcast ? bcast - mcast : 0;
+  fprintf(stderr, "Multicast saved %lu bytes on the lines, %.1f%% of the broadcast; the switch counts %lu pruned\n",
+          saved, bcast ? 100.0 * saved / bcast : 0, pruned);
+
+  star_exit();
+}
@@ -0,0 +1,153 @@
+/*Load generator for the host switch. Creates one pseudo-terminal pair per emulated node, runs the switch on the master
+ends and a node thread on each slave end, then floods unicast frames from every node to the next one.
+  pty_loadgen <nodes> <groups> <seconds> [payload bytes]
+Run it with groups = 1 and groups = nodes to compare one data plane thread pair against one per port. The link layer's
+own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <host_switch.h>
+#include <link.h>
+#include <routing.h>
+
+#include <pty.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define LOADGEN_WARMUP_MS		1500		//Time for the nodes to join before the flood starts
+#define LOADGEN_HELLO_MS		1000
+
+static SerialPort sw_streams[MAX_ADDRESS - 1];
+static SerialPort node_streams[MAX_ADDRESS - 1];
+static LINK node_links[MAX_ADDRESS - 1];
+static unsigned long sent[MAX_ADDRESS - 1];
+static unsigned long received[MAX_ADDRESS - 1];
+static volatile uint8_t measuring = 0;
+static uint8_t total_nodes;
+static uint8_t payload_size = 16;
+
+
+void* node_thread(void *arg)
+{
+  uint8_t i = (uint8_t)(intptr_t)arg;
+  uint8_t id = i + 1;
+  uint8_t peer = (i + 1) % total_nodes + 1;
+  LINK *link = &node_links[i];
+  uchar payload[255];
+  unsigned long last_hello = 0, start = millis();
+  uint8_t ready;
+  FRAME frame;
+  PortPoller poller;
+
+  memset(payload, id, sizeof(payload));
+  link_init(&node_streams[i], id, ENDPOINT, link);
+  send_hello(id, 0, link);
+  send_join_msg(id, link);
+  poller.add(&node_streams[i], i);
+
+  while (1)
+  {
+    if (read_serial(link) > 0)
+    {
+      while (link->rqueue_pending > 0)
+      {
+        frame = pop_recv_queue(link);
+
+        if (frame.src == 0 || frame.preamble == CFRAME_PREAMBLE)
+          parse_control_frame(frame, link);
+        else if (measuring)
+          received[i]++;
+
+        free(frame.payload);
+      }
+    }
+
+    if (millis() - last_hello >= LOADGEN_HELLO_MS)
+    {
+      last_hello = millis();
+      send_hello(id, 0, link);
+    }
+
+    //Keep the send queue topped up once everyone has joined
+    if (millis() - start > LOADGEN_WARMUP_MS && link->squeue_pending == 0)
+      if (create_send_frame(id, peer, payload_size, payload, link) && measuring)
+        sent[i]++;
+
+    if (!transmit_next(link))
+      poller.wait(&ready, 1, 1);
+  }
+
+  return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+  SWITCH_PORT ports[MAX_ADDRESS - 1];
+  HOST_PORT_STATS st;
+  unsigned long total_sent = 0, total_received = 0, total_fwd = 0;
+  uint8_t groups, i;
+  int seconds, master, slave;
+  char name[64];
+  pthread_t thread;
+
+  if (argc < 4)
+  {
+    fprintf(stderr, "usage: %s <nodes> <groups> <seconds> [payload bytes]\n", argv[0]);
+    return 1;
+  }
+
+  total_nodes = atoi(argv[1]);
+  seconds = atoi(argv[3]);
+  if (argc > 4)
+    payload_size = atoi(argv[4]);
+
+  if (total_nodes < 2 || total_nodes > MAX_ADDRESS - 1 || total_nodes > TOTAL_LINKS)
+  {
+    fprintf(stderr, "nodes must be between 2 and %d\n", min(MAX_ADDRESS - 1, TOTAL_LINKS));
+    return 1;
+  }
+
+  for (i = 0; i < total_nodes; i++)
+  {
+    if (openpty(&master, &slave, name, NULL, NULL) < 0)
+    {
+      perror("openpty");
+      return 1;
+    }
+
+    //The node end is opened by name, like a real device would be
+    if (!SerialPort::configure(master, SWITCH_LINK_BAUD) || !node_streams[i].open(name, SWITCH_LINK_BAUD))
+      return 1;
+
+    close(slave);
+    sw_streams[i].attach(master);
+    ports[i].port = &sw_streams[i];
+    ports[i].baud = SWITCH_LINK_BAUD;
+  }
+
+  groups = host_switch_start(ports, total_nodes, atoi(argv[2]));
+  if (groups == 0)
+    return 1;
+
+  for (i = 0; i < total_nodes; i++)
+    pthread_create(&thread, NULL, node_thread, (void*)(intptr_t)i);
+
+  usleep(2 * LOADGEN_WARMUP_MS * 1000UL);
+  measuring = 1;
+  sleep(seconds);
+  measuring = 0;
+
+  for (i = 0; i < total_nodes; i++)
+  {
+    host_switch_stats(i, &st);
+    total_sent += sent[i];
+    total_received += received[i];
+    total_fwd += st.fwd_frames;
+    fprintf(stderr, "node %2d: sent %lu received %lu | port rx %lu fwd %lu drops %lu\n", i + 1, sent[i], received[i],
+            st.rx_frames, st.fwd_frames, st.drops);
+  }
+
+  fprintf(stderr, "%d nodes, %d thread groups, %d byte payloads: %lu frames/s delivered (%lu fast path total)\n",
+          total_nodes, groups, payload_size, total_received / seconds, total_fwd);
+
+  return 0;
+}
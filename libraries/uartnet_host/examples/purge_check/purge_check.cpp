@@ -0,0 +1,109 @@
+/*Checks that the frames queued for a dead node are purged, and that multicasts to the group with the same number are
+kept. GFRAMEs carry a group where other frames carry a node, so the two look alike to anything that only reads the
+address byte. Node 2 dies twice, with a unicast and a group 2 multicast queued both times:
+  - on a node's own send queue, purged by purge_send_queue()
+  - in a switch's virtual output queues, killed the way the switch does when its heartbeats stop (withdraw_node())
+What reaches the far end of the line is counted. Exits with 1 if a unicast got through or a multicast did not.
+  purge_check
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <switch.h>
+#include <shm_link.h>
+#include <link.h>
+
+#include <unistd.h>
+
+#define CHECK_DEAD				2			//The node that dies, and the group with its number
+#define CHECK_WAIT_MS			300			//How long the far end listens
+
+//Switch internals, driven directly
+uint8_t voq_enqueue(RAW_FRAME raw, uint8_t in, uint8_t e);
+void withdraw_node(uint8_t id, uint8_t reason, LINK *ingress);
+
+
+//Counts the frames for the dead node and for its group that reach the far end. The switch keeps running meanwhile
+void count_far_end(LINK *far, LINK *near, uint8_t run_switch, unsigned *unicast, unsigned *multicast)
+{
+  unsigned long start = millis();
+  FRAME frame;
+
+  *unicast = *multicast = 0;
+
+  while (millis() - start < CHECK_WAIT_MS)
+  {
+    if (run_switch)
+      switch_task(0);
+    else
+      while (transmit_next(near));
+
+    read_serial(far);
+    while (far->rqueue_pending > 0)
+    {
+      frame = pop_recv_queue(far);
+
+      if (frame.dst == CHECK_DEAD && frame.preamble == MFRAME_PREAMBLE)
+        (*unicast)++;
+      else if (frame.dst == CHECK_DEAD && frame.preamble == GFRAME_PREAMBLE)
+        (*multicast)++;
+
+      free(frame.payload);
+    }
+
+    usleep(1000);
+  }
+}
+
+
+uint8_t report(const char *where, unsigned unicast, unsigned multicast)
+{
+  uint8_t ok = (unicast == 0 && multicast == 1);
+
+  fprintf(stderr, "%s: %u unicasts and %u multicasts got through: %s\n", where, unicast, multicast, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+
+int main()
+{
+  static ShmLink lines[6];
+  SWITCH_PORT ports[2];
+  LINK node, far_node, far_switch;
+  char name[SHM_LINK_NAME_SIZE];
+  uchar payload[8] = "purged?";
+  uint8_t i, purged, ok;
+  unsigned unicast, multicast;
+
+  //lines[0]/[1]: a node and what is across its line. lines[2]/[3] and [4]/[5]: the switch's two ports and their far ends
+  for (i = 0; i < 3; i++)
+  {
+    snprintf(name, sizeof(name), "/purge_check_%d_%d", getpid(), i);
+    if (!lines[2 * i].create(name) || !lines[2 * i + 1].attach(name))
+      return 1;
+  }
+
+  //The node's send queue
+  link_init(&lines[0], 1, ENDPOINT, &node);
+  link_init(&lines[1], 3, ENDPOINT, &far_node);
+  create_send_frame(1, CHECK_DEAD, sizeof(payload), payload, &node);
+  create_send_gframe(1, CHECK_DEAD, sizeof(payload), payload, &node);
+
+  purged = purge_send_queue(CHECK_DEAD, &node);
+  count_far_end(&far_node, &node, 0, &unicast, &multicast);
+  ok = report("node send queue", unicast, multicast) && purged == 1;
+
+  //The switch's queues, from port 0 to port 1
+  ports[0].port = &lines[2];
+  ports[1].port = &lines[4];
+  ports[0].baud = ports[1].baud = 0;
+  switch_init_ports(ports, 2);
+  link_init(&lines[5], 3, ENDPOINT, &far_switch);
+
+  voq_enqueue(frame_to_raw(create_frame(1, CHECK_DEAD, sizeof(payload), payload)), 0, 1);
+  voq_enqueue(frame_to_raw(create_gframe(1, CHECK_DEAD, sizeof(payload), payload)), 0, 1);
+
+  withdraw_node(CHECK_DEAD, 0, NULL);
+  count_far_end(&far_switch, NULL, 1, &unicast, &multicast);
+  ok &= report("switch VOQs", unicast, multicast);
+
+  return ok ? 0 : 1;
+}
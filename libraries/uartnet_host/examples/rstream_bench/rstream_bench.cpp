@@ -0,0 +1,140 @@
+/*Goodput of reliable streams against line noise. Node 1 sends a series of streams to node 2, over one hop (a direct
+line) or two (through a host switch), set up by the bench pair (see bench_pair.h).
+  rstream_bench <hops> <bit error rate> [stream bytes] [streams]
+Build it a second time with -DRS_SACK_SEGMENTS=0 to compare against cumulative ACKs only.
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <bench_pair.h>
+
+#include <unistd.h>
+
+#define BENCH_WARMUP_MS			2000		//Time for the nodes to join before the first stream
+#define BENCH_TIMEOUT_MS		120000
+
+
+static uchar *data;
+static uint32_t stream_size = 8192;
+static uint8_t total_streams = 4;
+
+//Results
+static uint8_t sent_done = 0, sent_failed = 0;
+static uint8_t recvd_ok = 0, recvd_corrupt = 0;
+static unsigned long start_ms, last_delivery_ms;
+
+
+void sender(BENCH_NODE *node)
+{
+  uint8_t started = 0, state;
+
+  while (bench_running)
+  {
+    bench_poll(node);
+
+    if (millis() < BENCH_WARMUP_MS)
+      continue;
+
+    state = transport_stream_state(&node->tr, 2);
+    if (state == CONN_SYN_SENT || state == CONN_OPEN)
+      continue;
+
+    if (started > 0 && state == CONN_DONE)
+      sent_done++;
+    else if (started > 0)
+      sent_failed++;
+
+    if (started == total_streams)
+      break;
+
+    if (started == 0)
+      start_ms = millis();
+
+    transport_send_stream(&node->tr, 2, data, stream_size);
+    started++;
+  }
+
+  while (bench_running)
+    bench_poll(node);
+}
+
+
+void receiver(BENCH_NODE *node)
+{
+  RECVD_DATA recvd;
+
+  while (bench_running)
+  {
+    bench_poll(node);
+
+    while (transport_recv(&node->tr, &recvd))
+    {
+      if (recvd.data.message.size == stream_size && memcmp(recvd.data.message.payload, data, stream_size) == 0)
+        recvd_ok++;
+      else
+        recvd_corrupt++;
+
+      last_delivery_ms = millis();
+      transport_free(&recvd);
+    }
+  }
+}
+
+
+void* node_thread(void *arg)
+{
+  BENCH_NODE *node = (BENCH_NODE*)arg;
+
+  if (node->id == 1)
+    sender(node);
+  else
+    receiver(node);
+
+  return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+  uint8_t hops;
+  unsigned long elapsed;
+  double ber;
+
+  if (argc < 3 || !(hops = bench_hops(argv[1])))
+  {
+    fprintf(stderr, "usage: %s <hops: 1 or 2> <bit error rate> [stream bytes] [streams]\n", argv[0]);
+    return 1;
+  }
+
+  ber = atof(argv[2]);
+  if (argc > 3)
+    stream_size = strtoul(argv[3], NULL, 10);
+  if (argc > 4)
+    total_streams = atoi(argv[4]);
+
+  srandom(getpid());
+  data = (uchar*)malloc(stream_size);
+  for (uint32_t j = 0; j < stream_size; j++)
+    data[j] = random();
+
+  if (!bench_start("rstream_bench", hops, ber, 0, node_thread))
+    return 1;
+
+  while (sent_done + sent_failed < total_streams && millis() < BENCH_TIMEOUT_MS)
+    usleep(10000);
+
+  //Give the last delivery time to reach the user
+  usleep(500000);
+  bench_stop();
+
+  elapsed = max(last_delivery_ms - start_ms, 1UL);
+  fprintf(stderr, "%d hop(s), BER %g: %d/%d streams delivered intact, %d corrupt, %d failed\n", hops, ber, recvd_ok,
+          total_streams, recvd_corrupt, sent_failed);
+  fprintf(stderr, "  goodput %lu B/s (%lu B/s delivered), %lu bytes resent of %lu sent, %lu timeouts, %lu bits flipped\n",
+          recvd_ok * stream_size * 1000UL / elapsed, (recvd_ok + recvd_corrupt) * stream_size * 1000UL / elapsed,
+          bench_nodes[0].tr.rs_bytes_resent, bench_nodes[0].tr.rs_bytes_sent, bench_nodes[0].tr.rs_timeouts,
+          bench_bits_flipped());
+  fprintf(stderr, "  %lu bad checksums at the receiver, %lu at the sender; %lu frames of unknown type at the receiver, "
+          "%lu at the sender\n", bench_nodes[1].tr.rs_bad_checksums, bench_nodes[0].tr.rs_bad_checksums,
+          bench_nodes[1].tr.recvd_bad_types, bench_nodes[0].tr.recvd_bad_types);
+
+  bench_exit();
+}
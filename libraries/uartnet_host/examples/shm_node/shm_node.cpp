@@ -0,0 +1,89 @@
+/*Node process on a shared-memory line created by host_switch (shm:NAME). Floods messages to a peer node, counts what
+it receives, and prints the rates when done.
+  shm_node <name> <id> <peer> <seconds> [baud] [payload bytes]
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <shm_link.h>
+#include <link.h>
+#include <routing.h>
+
+#include <unistd.h>
+
+#define SHM_NODE_WARMUP_MS		1500		//Time for both nodes to join before the flood starts
+#define SHM_NODE_HELLO_MS		1000
+
+
+int main(int argc, char **argv)
+{
+  ShmLink line;
+  LINK link;
+  FRAME frame;
+  uchar payload[MAX_PAYLOAD_SIZE];
+  char name[SHM_LINK_NAME_SIZE];
+  uint8_t id, peer, payload_size = 16;
+  unsigned long baud = 0, seconds, start, last_hello = 0;
+  unsigned long sent = 0, received = 0, received_bytes = 0;
+
+  if (argc < 5)
+  {
+    fprintf(stderr, "usage: %s <name> <id> <peer> <seconds> [baud] [payload bytes]\n", argv[0]);
+    return 1;
+  }
+
+  snprintf(name, sizeof(name), "/%s", argv[1]);
+  id = atoi(argv[2]);
+  peer = atoi(argv[3]);
+  seconds = atoi(argv[4]);
+  if (argc > 5)
+    baud = strtoul(argv[5], NULL, 10);
+  if (argc > 6)
+    payload_size = atoi(argv[6]);
+
+  if (!line.attach(name, baud))
+    return 1;
+
+  memset(payload, id, sizeof(payload));
+  link_init(&line, id, ENDPOINT, &link);
+  send_hello(id, 0, &link);
+  send_join_msg(id, &link);
+
+  start = millis();
+  while (millis() - start < SHM_NODE_WARMUP_MS + seconds * 1000)
+  {
+    if (read_serial(&link) > 0)
+    {
+      while (link.rqueue_pending > 0)
+      {
+        frame = pop_recv_queue(&link);
+
+        if (frame.src == 0 || frame.preamble == CFRAME_PREAMBLE)
+          parse_control_frame(frame, &link);
+        else if (millis() - start > SHM_NODE_WARMUP_MS)
+        {
+          received++;
+          received_bytes += frame.size;
+        }
+
+        free(frame.payload);
+      }
+    }
+
+    if (millis() - last_hello >= SHM_NODE_HELLO_MS)
+    {
+      last_hello = millis();
+      send_hello(id, 0, &link);
+    }
+
+    if (millis() - start > SHM_NODE_WARMUP_MS && link.squeue_pending == 0)
+      if (create_send_frame(id, peer, payload_size, payload, &link))
+        sent++;
+
+    if (!transmit_next(&link) && line.available() == 0)
+      usleep(SHM_LINK_WAIT_US);
+  }
+
+  fprintf(stderr, "node %d: sent %lu, received %lu (%lu frames/s, %lu payload bytes/s)\n", id, sent, received,
+          received / seconds, received_bytes / seconds);
+
+  return 0;
+}
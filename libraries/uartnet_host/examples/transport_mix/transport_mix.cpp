@@ -0,0 +1,178 @@
+/*Throughput of the transport layer under mixed traffic. Nodes 1 and 2 each keep a reliable stream, a fragmented
+message and a trickle of single-frame messages going to the other, over one hop (a direct line) or two (through a host
+switch), set up by the bench pair (see bench_pair.h) without noise.
+  transport_mix <hops> [seconds] [stream bytes] [message bytes] [frame bytes]
+Besides what each class delivered, it times the receive pump (transport_check_recv) per frame taken.
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <bench_pair.h>
+
+#include <unistd.h>
+
+#define BENCH_WARMUP_MS			2000		//Time for the nodes to join before the traffic starts
+#define BENCH_FRAME_MS			20			//Gap between single-frame messages
+
+
+enum {CLASS_STREAM = 0, CLASS_MESSAGE, CLASS_FRAME, TOTAL_CLASSES};
+static const char *class_names[TOTAL_CLASSES] = {"streams", "messages", "frames"};
+
+//What each node received
+typedef struct {
+  unsigned long bytes[TOTAL_CLASSES];
+  unsigned long count[TOTAL_CLASSES];
+  unsigned long corrupt;
+} NODE_RESULTS;
+
+static NODE_RESULTS results[2];
+static volatile uint8_t measuring = 0;
+static uchar *data[TOTAL_CLASSES];
+static uint32_t sizes[TOTAL_CLASSES] = {16384, 1024, 64};
+
+
+//Which class a delivery belongs to, going by its size. Sizes are checked to differ at startup
+uint8_t classify(RECVD_DATA *recvd)
+{
+  uint8_t c;
+
+  for (c = 0; c < TOTAL_CLASSES; c++)
+    if (recvd->data.message.size == sizes[c])
+      return c;
+
+  return TOTAL_CLASSES;
+}
+
+
+void* node_thread(void *arg)
+{
+  BENCH_NODE *node = (BENCH_NODE*)arg;
+  NODE_RESULTS *res = &results[node->id - 1];
+  uint8_t peer = 3 - node->id, c, state;
+  unsigned long last_frame = 0;
+  RECVD_DATA recvd;
+
+  while (bench_running)
+  {
+    bench_poll(node);
+
+    while (transport_recv(&node->tr, &recvd))
+    {
+      c = classify(&recvd);
+
+      if (c == TOTAL_CLASSES || memcmp(recvd.data.message.payload, data[c], sizes[c]) != 0)
+        res->corrupt++;
+      else if (measuring)
+      {
+        res->bytes[c] += sizes[c];
+        res->count[c]++;
+      }
+
+      transport_free(&recvd);
+    }
+
+    if (millis() < BENCH_WARMUP_MS)
+      continue;
+
+    state = transport_stream_state(&node->tr, peer);
+    if (state != CONN_SYN_SENT && state != CONN_OPEN)
+      transport_send_stream(&node->tr, peer, data[CLASS_STREAM], sizes[CLASS_STREAM]);
+
+    if (transport_messages_queued(&node->tr) == 0)
+      transport_send_message(&node->tr, peer, data[CLASS_MESSAGE], sizes[CLASS_MESSAGE]);
+
+    if (millis() - last_frame >= BENCH_FRAME_MS)
+    {
+      last_frame = millis();
+      send_umpacket(create_umpacket(node->id, peer, sizes[CLASS_FRAME], data[CLASS_FRAME]), &node->link);
+    }
+  }
+
+  return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+  uint8_t hops, i, c;
+  unsigned long seconds = 10, total, frames_pumped[2];
+  unsigned long long pump_ns[2];
+  BENCH_NODE *node;
+  NODE_RESULTS *res;
+  HOST_PORT_STATS stats;
+
+  if (argc < 2 || !(hops = bench_hops(argv[1])))
+  {
+    fprintf(stderr, "usage: %s <hops: 1 or 2> [seconds] [stream bytes] [message bytes] [frame bytes]\n", argv[0]);
+    return 1;
+  }
+
+  if (argc > 2)
+    seconds = strtoul(argv[2], NULL, 10);
+  for (c = 0; c < TOTAL_CLASSES && argc > 3 + c; c++)
+    sizes[c] = strtoul(argv[3 + c], NULL, 10);
+
+  sizes[CLASS_MESSAGE] = constrain(sizes[CLASS_MESSAGE], 1UL, 0xFFFFUL);
+  sizes[CLASS_FRAME] = constrain(sizes[CLASS_FRAME], 1UL, (unsigned long)UMPACKET_MAX_PAYLOAD);
+  if (sizes[0] == sizes[1] || sizes[1] == sizes[2] || sizes[0] == sizes[2])
+  {
+    fprintf(stderr, "Each class needs a size of its own\n");
+    return 1;
+  }
+
+  srandom(getpid());
+  for (c = 0; c < TOTAL_CLASSES; c++)
+  {
+    data[c] = (uchar*)malloc(sizes[c]);
+    for (uint32_t j = 0; j < sizes[c]; j++)
+      data[c][j] = random();
+  }
+
+  if (!bench_start("transport_mix", hops, 0, 0, node_thread))
+    return 1;
+
+  //Measure once the traffic has settled
+  usleep((BENCH_WARMUP_MS + 1000) * 1000UL);
+  for (i = 0; i < 2; i++)
+  {
+    frames_pumped[i] = bench_nodes[i].frames_pumped;
+    pump_ns[i] = bench_nodes[i].pump_ns;
+  }
+
+  measuring = 1;
+  sleep(seconds);
+  measuring = 0;
+
+  for (i = 0; i < 2; i++)
+  {
+    frames_pumped[i] = bench_nodes[i].frames_pumped - frames_pumped[i];
+    pump_ns[i] = bench_nodes[i].pump_ns - pump_ns[i];
+  }
+  bench_stop();
+
+  fprintf(stderr, "%d hop(s), %lu s at %d baud\n", hops, seconds, RS_LINK_BAUD);
+  for (i = 0; i < 2; i++)
+  {
+    node = &bench_nodes[i];
+    res = &results[i];
+    total = 0;
+
+    fprintf(stderr, "  node %d received:", node->id);
+    for (c = 0; c < TOTAL_CLASSES; c++)
+    {
+      fprintf(stderr, " %lu %s (%lu B/s)", res->count[c], class_names[c], res->bytes[c] / seconds);
+      total += res->bytes[c];
+    }
+
+    fprintf(stderr, "\n    total %lu B/s, %lu corrupt, %lu dropped at the queue; pump %lu frames/s, %llu ns per frame\n",
+            total / seconds, res->corrupt, node->tr.recvd_dropped, frames_pumped[i] / seconds,
+            frames_pumped[i] ? pump_ns[i] / frames_pumped[i] : 0);
+  }
+
+  //Unreliable traffic has no flow control, so whatever the switch could not fit in its rings shows up here
+  for (i = 0; hops == 2 && i < 2; i++)
+  {
+    host_switch_stats(i, &stats);
+    fprintf(stderr, "  switch port %d: %lu frames received, %lu dropped\n", i, stats.rx_frames, stats.drops);
+  }
+
+  bench_exit();
+}
@@ -0,0 +1,188 @@
+/*Loopback test of the UDP gateway. A host switch runs over pseudo-terminals, with echo nodes on all ports but the
+first, and the gateway on the first as node UDP_LOOPBACK_ID. A UDP client then keeps a window of datagrams in flight
+through the gateway to every echo node, and measures what comes back.
+  udp_loopback <echo nodes> <seconds> [payload bytes]
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <host_switch.h>
+#include <udp_gateway.h>
+
+#include <pty.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define UDP_LOOPBACK_ID			14
+#define UDP_LOOPBACK_WINDOW		8			//Datagrams in flight per echo node
+#define UDP_LOOPBACK_WARMUP_MS	3000
+
+static SerialPort sw_streams[MAX_ADDRESS];
+static SerialPort node_streams[MAX_ADDRESS];
+static UdpGateway gateway;
+
+
+//Sends every message straight back to where it came from
+void* echo_thread(void *arg)
+{
+  uint8_t i = (uint8_t)(intptr_t)arg;
+  uint8_t id = i, ready;
+  LINK link;
+  PortPoller poller;
+  unsigned long last_hello = 0;
+  FRAME frame;
+
+  link_init(&node_streams[i], id, ENDPOINT, &link);
+  send_hello(id, 0, &link);
+  send_join_msg(id, &link);
+  poller.add(&node_streams[i], i);
+
+  while (1)
+  {
+    if (read_serial(&link) > 0)
+    {
+      while (link.rqueue_pending > 0)
+      {
+        frame = pop_recv_queue(&link);
+
+        if (frame.src == 0 || frame.preamble == CFRAME_PREAMBLE)
+          parse_control_frame(frame, &link);
+        else
+          create_send_frame(id, frame.src, frame.size, frame.payload, &link);
+
+        free(frame.payload);
+      }
+    }
+
+    if (millis() - last_hello >= UDP_GW_HELLO_MS)
+    {
+      last_hello = millis();
+      send_hello(id, 0, &link);
+    }
+
+    while (transmit_next(&link));
+    poller.wait(&ready, 1, 10);
+  }
+
+  return NULL;
+}
+
+
+void* gateway_thread(void*)
+{
+  while (1)
+    gateway.task(10);
+
+  return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+  SWITCH_PORT ports[MAX_ADDRESS];
+  UDP_GW_STATS st;
+  uint8_t total_nodes, payload_size = 16, gw_id = UDP_LOOPBACK_ID, i;
+  uint8_t in_flight[MAX_ADDRESS];
+  uchar buf[MAX_PAYLOAD_SIZE + 1];
+  unsigned long start, sent_at, echoed = 0, rtt_sum = 0;
+  struct sockaddr_in gw_addr;
+  struct timeval tv = {0, 100000};
+  int seconds, master, slave, sock, n;
+  char name[64];
+  pthread_t thread;
+
+  if (argc < 3)
+  {
+    fprintf(stderr, "usage: %s <echo nodes> <seconds> [payload bytes]\n", argv[0]);
+    return 1;
+  }
+
+  total_nodes = atoi(argv[1]);
+  seconds = atoi(argv[2]);
+  if (argc > 3)
+    payload_size = max(atoi(argv[3]), (int)sizeof(unsigned long));
+
+  if (total_nodes < 1 || total_nodes >= UDP_LOOPBACK_ID || total_nodes >= TOTAL_LINKS)
+  {
+    fprintf(stderr, "echo nodes must be between 1 and %d\n", min(UDP_LOOPBACK_ID, TOTAL_LINKS) - 1);
+    return 1;
+  }
+
+  //Port 0 is the gateway's, port i the echo node i's
+  for (i = 0; i <= total_nodes; i++)
+  {
+    if (openpty(&master, &slave, name, NULL, NULL) < 0)
+    {
+      perror("openpty");
+      return 1;
+    }
+
+    if (!SerialPort::configure(master, SWITCH_LINK_BAUD) || !node_streams[i].open(name, SWITCH_LINK_BAUD))
+      return 1;
+
+    close(slave);
+    sw_streams[i].attach(master);
+    ports[i].port = &sw_streams[i];
+    ports[i].baud = SWITCH_LINK_BAUD;
+  }
+
+  if (!host_switch_start(ports, total_nodes + 1, 0) || !gateway.begin(&node_streams[0], &gw_id, 1))
+    return 1;
+
+  pthread_create(&thread, NULL, gateway_thread, NULL);
+  for (i = 1; i <= total_nodes; i++)
+    pthread_create(&thread, NULL, echo_thread, (void*)(intptr_t)i);
+
+  usleep(UDP_LOOPBACK_WARMUP_MS * 1000UL);
+
+  //The client
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  memset(&gw_addr, 0, sizeof(gw_addr));
+  gw_addr.sin_family = AF_INET;
+  gw_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  gw_addr.sin_port = htons(UDP_GW_BASE_PORT + UDP_LOOPBACK_ID);
+  memset(in_flight, 0, sizeof(in_flight));
+  memset(buf, 0, sizeof(buf));
+
+  start = millis();
+  while (millis() - start < (unsigned long)seconds * 1000)
+  {
+    for (i = 1; i <= total_nodes; i++)
+    {
+      while (in_flight[i] < UDP_LOOPBACK_WINDOW)
+      {
+        buf[0] = i;
+        sent_at = micros();
+        memcpy(&buf[1], &sent_at, sizeof(sent_at));
+        sendto(sock, buf, payload_size + 1, 0, (struct sockaddr*)&gw_addr, sizeof(gw_addr));
+        in_flight[i]++;
+      }
+    }
+
+    n = recv(sock, buf, sizeof(buf), 0);
+
+    //Whatever the switch dropped is given up on after a quiet spell
+    if (n <= 0)
+    {
+      memset(in_flight, 0, sizeof(in_flight));
+      continue;
+    }
+
+    if (buf[0] >= 1 && buf[0] <= total_nodes && in_flight[buf[0]] > 0)
+      in_flight[buf[0]]--;
+
+    memcpy(&sent_at, &buf[1], sizeof(sent_at));
+    rtt_sum += micros() - sent_at;
+    echoed++;
+  }
+
+  gateway.stats(&st);
+  fprintf(stderr, "gateway: to net %lu frames (%lu bytes), to udp %lu frames (%lu bytes), drops %lu, %lu batches\n",
+          st.to_net_frames, st.to_net_bytes, st.to_udp_frames, st.to_udp_bytes, st.drops, st.batches);
+  fprintf(stderr, "gateway latency to UART: avg %lu us, max %lu us\n", st.lat_avg_us, st.lat_max_us);
+  fprintf(stderr, "%d echo nodes, %d byte payloads: %lu echoes/s, average round trip %lu us\n", total_nodes,
+          payload_size, echoed / seconds, echoed ? rtt_sum / echoed : 0);
+
+  return 0;
+}
@@ -0,0 +1,144 @@
+/*Delivery and reassembly cost of unreliable messages against line noise. Node 1 fragments a series of messages to
+node 2, over one hop (a direct line) or two (through a host switch), set up by the bench pair (see bench_pair.h).
+  umessage_bench <hops> <bit error rate> [message bytes] [messages]
+Messages over US_POOL_BLOCKS fragments are never delivered, so build with e.g. -DUS_POOL_BLOCKS=300 to try 64 KB ones.
+The link layer's own chatter goes to stdout, so redirect it; results are printed on stderr.*/
+
+#include <bench_pair.h>
+
+#include <unistd.h>
+
+#define BENCH_WARMUP_MS			2000		//Time for the nodes to join before the first message
+#define BENCH_TIMEOUT_MS		120000
+
+
+static volatile uint8_t sent_all = 0;
+static uchar *data;
+static uint16_t message_size = 2048;
+static unsigned long total_messages = 16;
+
+//Results
+static unsigned long recvd_ok = 0, recvd_corrupt = 0;
+static unsigned long start_ms, last_delivery_ms;
+
+
+void sender(BENCH_NODE *node)
+{
+  unsigned long queued = 0;
+
+  while (bench_running)
+  {
+    bench_poll(node);
+
+    if (queued == total_messages && transport_messages_queued(&node->tr) == 0)
+      sent_all = 1;
+
+    if (millis() < BENCH_WARMUP_MS || queued == total_messages)
+      continue;
+
+    if (queued == 0)
+      start_ms = millis();
+
+    //Every message is the same buffer, which is never written to
+    if (transport_send_message(&node->tr, 2, data, message_size))
+      queued++;
+  }
+}
+
+
+void receiver(BENCH_NODE *node)
+{
+  RECVD_DATA recvd;
+
+  while (bench_running)
+  {
+    bench_poll(node);
+
+    while (transport_recv(&node->tr, &recvd))
+    {
+      if (recvd.data.message.size == message_size && memcmp(recvd.data.message.payload, data, message_size) == 0)
+        recvd_ok++;
+      else
+        recvd_corrupt++;
+
+      last_delivery_ms = millis();
+      transport_free(&recvd);
+    }
+  }
+}
+
+
+void* node_thread(void *arg)
+{
+  BENCH_NODE *node = (BENCH_NODE*)arg;
+
+  if (node->id == 1)
+    sender(node);
+  else
+    receiver(node);
+
+  return NULL;
+}
+
+
+uint8_t reassembling(TRANSPORT *tr)
+{
+  uint8_t slot;
+
+  for (slot = 0; slot < US_MAX_REASSEMBLY; slot++)
+    if (__atomic_load_n(&tr->reassembly[slot].state, __ATOMIC_RELAXED) != RA_FREE)
+      return 1;
+
+  return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+  uint8_t hops;
+  unsigned long elapsed, lost;
+  double ber;
+  TRANSPORT *rx = &bench_nodes[1].tr;
+
+  if (argc < 3 || !(hops = bench_hops(argv[1])))
+  {
+    fprintf(stderr, "usage: %s <hops: 1 or 2> <bit error rate> [message bytes] [messages]\n", argv[0]);
+    return 1;
+  }
+
+  ber = atof(argv[2]);
+  if (argc > 3)
+    message_size = constrain(strtoul(argv[3], NULL, 10), 1UL, 0xFFFFUL);
+  if (argc > 4)
+    total_messages = strtoul(argv[4], NULL, 10);
+
+  srandom(getpid());
+  data = (uchar*)malloc(message_size);
+  for (uint32_t j = 0; j < message_size; j++)
+    data[j] = random();
+
+  if (!bench_start("umessage_bench", hops, ber, 0, node_thread))
+    return 1;
+
+  //Done once everything was sent and the receiver has delivered or timed out every message it was collecting
+  while (!sent_all && millis() < BENCH_TIMEOUT_MS)
+    usleep(10000);
+  usleep(100000);
+  while (reassembling(rx) && millis() < BENCH_TIMEOUT_MS)
+    usleep(10000);
+
+  usleep(100000);
+  bench_stop();
+
+  elapsed = max(last_delivery_ms - start_ms, 1UL);
+  lost = total_messages - min(recvd_ok + recvd_corrupt, total_messages);
+  fprintf(stderr, "%d hop(s), BER %g: %lu/%lu messages delivered intact, %lu corrupt, %lu lost\n",
+          hops, ber, recvd_ok, total_messages, recvd_corrupt, lost);
+  fprintf(stderr, "  %lu expired, %lu evicted, %lu fragments dropped\n", rx->us_expired, rx->us_evicted, rx->us_dropped);
+  fprintf(stderr, "  goodput %lu B/s, latency avg %lu ms max %lu ms, pool high-water %u/%u blocks (%lu bytes), "
+          "%lu bits flipped\n", recvd_ok * message_size * 1000UL / elapsed,
+          rx->us_delivered ? rx->us_latency_total / rx->us_delivered : 0, rx->us_latency_max, rx->us_blocks_high,
+          US_POOL_BLOCKS, (unsigned long)rx->us_blocks_high * US_FRAGMENT_SIZE, bench_bits_flipped());
+
+  bench_exit();
+}
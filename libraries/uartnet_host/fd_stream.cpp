@@ -0,0 +1,107 @@
+#include "fd_stream.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+
+FdStream::FdStream(int fd)
+{
+  my_fd = -1;
+  peeked = -1;
+
+  if (fd >= 0)
+    attach(fd);
+}
+
+
+void FdStream::attach(int fd)
+{
+  my_fd = fd;
+  peeked = -1;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+
+int FdStream::available()
+{
+  int bytes = 0;
+
+  if (my_fd < 0 || ioctl(my_fd, FIONREAD, &bytes) < 0)
+    return 0;
+
+  return bytes + (peeked >= 0);
+}
+
+
+int FdStream::read()
+{
+  uint8_t c;
+
+  if (peeked >= 0)
+  {
+    c = peeked;
+    peeked = -1;
+    return c;
+  }
+
+  return (::read(my_fd, &c, 1) == 1) ? c : -1;
+}
+
+
+int FdStream::peek()
+{
+  if (peeked < 0)
+    peeked = read();
+
+  return peeked;
+}
+
+
+size_t FdStream::readBytes(char *buffer, size_t length)
+{
+  size_t n = 0;
+  ssize_t got;
+
+  if (length == 0)
+    return 0;
+
+  if (peeked >= 0)
+  {
+    buffer[n++] = peeked;
+    peeked = -1;
+  }
+
+  got = ::read(my_fd, &buffer[n], length - n);
+  return (got > 0) ? n + got : n;
+}
+
+
+size_t FdStream::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+
+size_t FdStream::write(const uint8_t *buffer, size_t size)
+{
+  struct pollfd pfd = {my_fd, POLLOUT, 0};
+  size_t sent = 0;
+  ssize_t n;
+
+  while (sent < size)
+  {
+    n = ::write(my_fd, &buffer[sent], size - sent);
+
+    if (n > 0)
+      sent += n;
+    else if (n < 0 && (errno == EAGAIN || errno == EINTR))
+      poll(&pfd, 1, 100);
+    else
+      break;
+  }
+
+  return sent;
+}
@@ -0,0 +1,34 @@
+/*Stream over a Linux file descriptor (tty, pty, pipe or socket), so a LINK can run on it from a host*/
+
+#ifndef _UARTNET_HOST_FD_STREAMH_
+#define _UARTNET_HOST_FD_STREAMH_
+
+#include "Arduino.h"
+
+
+class FdStream : public Stream
+{
+  public:
+    FdStream(int fd = -1);
+
+    //Takes over fd and makes it non-blocking
+    void attach(int fd);
+    int fd() { return my_fd; }
+
+    int available();
+    int read();
+    int peek();
+    size_t readBytes(char *buffer, size_t length);
+
+    //Writes everything, waiting for the descriptor to drain if it has to
+    using Print::write;
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+
+  protected:
+    int my_fd;
+    int peeked;			//Byte taken by peek(), -1 if none
+};
+
+
+#endif
@@ -0,0 +1,420 @@
+#include "host_switch.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+static uint8_t total_ports = 0;
+static uint8_t total_groups = 1;
+static SWITCH_PORT phys[TOTAL_LINKS];           //The real ports
+static LINK rx_links[TOTAL_LINKS];              //Framing state of each port's RX side. Owned by its RX thread
+static HOST_PORT_STATS stats[TOTAL_LINKS];
+
+//Queues between threads. Each ring has exactly one producer and one consumer thread
+static FRAME_RING data_ring[TOTAL_LINKS][TOTAL_LINKS];     //[egress][ingress]: RX thread -> TX thread
+static FRAME_RING ctl_ring[TOTAL_LINKS];                   //Per egress: control plane -> TX thread
+static BYTE_RING slow_ring[TOTAL_LINKS];                   //Per ingress: RX thread -> control plane
+static uint32_t heard[TOTAL_LINKS];                        //Per ingress: senders whose frames the data plane forwarded
+
+
+/******************************/
+//Forwarding table
+/******************************/
+
+//RX threads read the current snapshot without locking. The control plane publishes a new one whenever the forwarding
+//state changes, and frees the old one only after every RX thread has been through a quiescent point since (RCU).
+static FWD_SNAPSHOT *fwd_current = NULL;
+static FWD_SNAPSHOT *fwd_retired = NULL;
+static unsigned long rx_epoch[TOTAL_LINKS];     //Per RX thread. Bumped between frames, when it holds no snapshot
+static unsigned long retire_epoch[TOTAL_LINKS];
+
+
+void publish_fwd()
+{
+  FWD_SNAPSHOT *snap = (FWD_SNAPSHOT*)malloc(sizeof(FWD_SNAPSHOT));
+  uint8_t g;
+
+  switch_fwd_export(snap);
+
+  if (fwd_current != NULL && memcmp(snap, fwd_current, sizeof(FWD_SNAPSHOT)) == 0)
+  {
+    free(snap);
+    return;
+  }
+
+  //Only one old snapshot is kept. Wait out its readers before retiring the next
+  if (fwd_retired != NULL)
+  {
+    for (g = 0; g < total_groups; g++)
+      while (__atomic_load_n(&rx_epoch[g], __ATOMIC_SEQ_CST) == retire_epoch[g])
+        sched_yield();
+
+    free(fwd_retired);
+  }
+
+  fwd_retired = fwd_current;
+  __atomic_store_n(&fwd_current, snap, __ATOMIC_SEQ_CST);
+
+  for (g = 0; g < total_groups; g++)
+    retire_epoch[g] = __atomic_load_n(&rx_epoch[g], __ATOMIC_SEQ_CST);
+}
+
+
+/******************************/
+//Control plane
+/******************************/
+
+//The control plane's view of a port. It reads what the RX thread left for it, and its writes go to the TX thread.
+//The switch core only ever writes whole frames in one call (cut-through is off), so every write is one frame.
+class ControlPort : public Stream
+{
+  public:
+    uint8_t idx;
+
+    int available() { return byte_ring_count(&slow_ring[idx]); }
+    int peek() { return byte_ring_peek(&slow_ring[idx]); }
+
+    int read()
+    {
+      uint8_t c;
+      return byte_ring_read(&slow_ring[idx], &c, 1) ? c : -1;
+    }
+
+    size_t readBytes(char *buffer, size_t length)
+    {
+      return byte_ring_read(&slow_ring[idx], (uint8_t*)buffer, length);
+    }
+
+    using Print::write;
+    size_t write(uint8_t c) { return write(&c, 1); }
+
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+      RAW_FRAME raw;
+
+      raw.size = size;
+      raw.buf = (uchar*)malloc(size + RAW_SPARE_SIZE);
+      raw.refs = NULL;
+      memcpy(raw.buf, buffer, size);
+
+      if (!frame_ring_push(&ctl_ring[idx], raw))
+      {
+        free(raw.buf);
+        return 0;
+      }
+
+      return size;
+    }
+};
+
+static ControlPort ctl_ports[TOTAL_LINKS];
+
+
+//Tell the switch core about senders it did not see, since the data plane forwarded their frames
+void drain_heard()
+{
+  uint8_t i, id;
+  uint32_t bits;
+
+  for (i = 0; i < total_ports; i++)
+  {
+    bits = __atomic_exchange_n(&heard[i], 0, __ATOMIC_ACQ_REL);
+
+    while (bits)
+    {
+      id = __builtin_ctz(bits);
+      bits &= bits - 1;
+      switch_note_heard(id, i);
+    }
+  }
+}
+
+
+void* control_thread(void*)
+{
+  SWITCH_PORT table[TOTAL_LINKS];
+  uint8_t i;
+
+  for (i = 0; i < total_ports; i++)
+  {
+    table[i].port = &ctl_ports[i];
+    table[i].baud = phys[i].baud;
+  }
+
+  switch_init_ports(table, total_ports);
+  switch_set_cut_through(0);
+
+  while (1)
+  {
+    switch_task(0);
+    drain_heard();
+    publish_fwd();
+  }
+
+  return NULL;
+}
+
+
+/******************************/
+//Data plane
+/******************************/
+
+//Unicast messages go straight to the egress TX thread. Everything else is left to the control plane
+void forward(RAW_FRAME raw, uint8_t in)
+{
+  static __thread uint8_t rr = 0;
+  uint16_t preamble = *((uint16_t*)&raw.buf[0]);
+  uint8_t src = raw.buf[2] & 0x0F;
+  uint8_t dst = (uint8_t)raw.buf[2] >> 4;
+  FWD_SNAPSHOT *snap = __atomic_load_n(&fwd_current, __ATOMIC_SEQ_CST);
+  uint8_t port, n, e;
+  RAW_FRAME wire;
+
+  stats[in].rx_frames++;
+
+  if (snap != NULL && preamble == MFRAME_PREAMBLE && dst != 0 && dst != MAX_ADDRESS && !RAW_ABORTED(raw))
+  {
+    __atomic_fetch_or(&heard[in], (uint32_t)1 << src, __ATOMIC_RELAXED);
+
+    port = snap->port[dst];
+    if (port == TOTAL_LINKS || port == snap->bond_of[in] || snap->member_count[port] == 0)
+    {
+      stats[in].drops++;
+      free(raw.buf);
+      return;
+    }
+
+    //Same member choice as bond_member()
+    if (snap->bond_mode == BOND_ROUND_ROBIN)
+      n = rr++ % snap->member_count[port];
+    else
+      n = ((src << ADDRESS_WIDTH) | dst) % snap->member_count[port];
+    e = snap->members[port][n];
+
+    //The TX thread only writes bytes out, so frames leaving with FEC are encoded here
+    if (snap->fec[e])
+    {
+      wire.buf = (uchar*)malloc(FEC_WIRE_SIZE(raw.buf[3]) + RAW_SPARE_SIZE);
+      wire.size = fec_encode(raw.buf, raw.size, wire.buf);
+      wire.refs = NULL;
+      free(raw.buf);
+      raw = wire;
+    }
+
+    if (!frame_ring_push(&data_ring[e][in], raw))
+    {
+      stats[in].drops++;
+      free(raw.buf);
+      return;
+    }
+
+    stats[in].fwd_frames++;
+    return;
+  }
+
+  if (!byte_ring_write(&slow_ring[in], raw.buf, raw.size))
+    stats[in].drops++;
+
+  free(raw.buf);
+}
+
+
+//Returns 0 if there was nothing new on the port
+uint8_t receive(uint8_t i)
+{
+  RAW_FRAME raw;
+
+  if (check_new_bytes(&rx_links[i]) == 0)
+    return 0;
+
+  raw = extract_frame_from_rbuf(&rx_links[i]);
+  while (raw.size > 0)
+  {
+    forward(raw, i);
+    proc_buf(NULL, 0, &rx_links[i]);
+    raw = extract_frame_from_rbuf(&rx_links[i]);
+  }
+
+  return 1;
+}
+
+
+//Sleeps in epoll until one of its ports has bytes. Ports without a descriptor are read on every wakeup, and make the
+//thread wake up every millisecond, or right away while they still have bytes.
+void* rx_thread(void *arg)
+{
+  uint8_t g = (uint8_t)(intptr_t)arg;
+  uint8_t polled[TOTAL_LINKS], ready[TOTAL_LINKS];
+  uint8_t total_polled = 0, busy = 0, i;
+  int n;
+  PortPoller poller;
+
+  for (i = g; i < total_ports; i += total_groups)
+    if (!poller.add(phys[i].port, i))
+      polled[total_polled++] = i;
+
+  while (1)
+  {
+    __atomic_store_n(&rx_epoch[g], rx_epoch[g] + 1, __ATOMIC_SEQ_CST);
+
+    n = poller.wait(ready, TOTAL_LINKS, busy ? 0 : (total_polled ? 1 : HOST_POLL_MS));
+    while (n > 0)
+      receive(ready[--n]);
+
+    busy = 0;
+    for (i = 0; i < total_polled; i++)
+      busy |= receive(polled[i]);
+  }
+
+  return NULL;
+}
+
+
+//Deficit round robin state of each egress, same scheme as the switch core's VOQs. Owned by the egress TX thread
+static uint16_t tx_deficit[TOTAL_LINKS][TOTAL_LINKS];
+static uint8_t tx_next[TOTAL_LINKS];
+static uint8_t tx_granted[TOTAL_LINKS];
+
+
+uint8_t drr_pick(uint8_t e, RAW_FRAME *raw)
+{
+  uint8_t n, in;
+  FRAME_RING *ring;
+
+  for (n = 0; n < 2 * total_ports; n++)
+  {
+    in = tx_next[e];
+    ring = &data_ring[e][in];
+
+    if (frame_ring_peek(ring, raw))
+    {
+      if (!tx_granted[e])
+      {
+        tx_deficit[e][in] += DRR_QUANTUM;
+        tx_granted[e] = 1;
+      }
+
+      if (raw->size <= tx_deficit[e][in])
+      {
+        tx_deficit[e][in] -= raw->size;
+        frame_ring_pop(ring);
+        return 1;
+      }
+    }
+    else
+      tx_deficit[e][in] = 0;
+
+    tx_next[e] = (in + 1) % total_ports;
+    tx_granted[e] = 0;
+  }
+
+  return 0;
+}
+
+
+void transmit(uint8_t e, RAW_FRAME raw)
+{
+  phys[e].port->write(raw.buf, raw.size);
+  stats[e].tx_frames++;
+  stats[e].tx_bytes += raw.size;
+  free(raw.buf);
+}
+
+
+void* tx_thread(void *arg)
+{
+  uint8_t g = (uint8_t)(intptr_t)arg;
+  uint8_t e, busy;
+  RAW_FRAME raw;
+
+  while (1)
+  {
+    busy = 0;
+
+    for (e = g; e < total_ports; e += total_groups)
+    {
+      //The control plane's own frames go first, like on the Mega
+      while (frame_ring_peek(&ctl_ring[e], &raw))
+      {
+        frame_ring_pop(&ctl_ring[e]);
+        transmit(e, raw);
+        busy = 1;
+      }
+
+      //Then one forwarded frame per visit, so ports sharing the thread take turns
+      if (drr_pick(e, &raw))
+      {
+        transmit(e, raw);
+        busy = 1;
+      }
+    }
+
+    if (!busy)
+      usleep(HOST_IDLE_US);
+  }
+
+  return NULL;
+}
+
+
+/******************************/
+//main
+/******************************/
+
+uint8_t host_switch_start(const SWITCH_PORT *ports, uint8_t count, uint8_t groups)
+{
+  pthread_t thread;
+  uint8_t i;
+
+  if (count > TOTAL_LINKS)
+  {
+    printf("ERROR: Only %d of %d ports can be used\n", TOTAL_LINKS, count);
+    count = TOTAL_LINKS;
+  }
+
+  if (groups == 0 || groups > count)
+    groups = count;
+
+  total_ports = count;
+  total_groups = groups;
+
+  for (i = 0; i < total_ports; i++)
+  {
+    phys[i] = ports[i];
+    ctl_ports[i].idx = i;
+    link_init(ports[i].port, 0, GATEWAY, &rx_links[i]);
+  }
+
+  //The data plane first, so every RX thread is already passing quiescent points once snapshots get published
+  for (i = 0; i < total_groups; i++)
+  {
+    if (pthread_create(&thread, NULL, rx_thread, (void*)(intptr_t)i) != 0 || pthread_detach(thread) != 0)
+      return 0;
+    if (pthread_create(&thread, NULL, tx_thread, (void*)(intptr_t)i) != 0 || pthread_detach(thread) != 0)
+      return 0;
+  }
+
+  if (pthread_create(&thread, NULL, control_thread, NULL) != 0 || pthread_detach(thread) != 0)
+    return 0;
+
+  return total_groups;
+}
+
+
+void host_switch_stats(uint8_t port, HOST_PORT_STATS *out)
+{
+  HOST_PORT_STATS *s = &stats[port];
+
+  if (port >= total_ports)
+  {
+    memset(out, 0, sizeof(HOST_PORT_STATS));
+    return;
+  }
+
+  //The port's RX and TX threads keep counting while we read. Each counter has only one writer
+  out->rx_frames = __atomic_load_n(&s->rx_frames, __ATOMIC_RELAXED);
+  out->fwd_frames = __atomic_load_n(&s->fwd_frames, __ATOMIC_RELAXED);
+  out->tx_frames = __atomic_load_n(&s->tx_frames, __ATOMIC_RELAXED);
+  out->tx_bytes = __atomic_load_n(&s->tx_bytes, __ATOMIC_RELAXED);
+  out->drops = __atomic_load_n(&s->drops, __ATOMIC_RELAXED);
+}
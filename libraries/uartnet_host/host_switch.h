@@ -0,0 +1,43 @@
+/*Multithreaded switch for a Linux host with many ports.
+
+The regular switch core (switch.cpp) keeps running as the control plane, on a thread of its own. Each of its links is
+a virtual port fed by the RX threads. Unicast message frames skip it: the RX thread of the ingress port looks up the
+egress in a read-mostly copy of the forwarding table, and hands the frame to the TX thread of the egress port through
+a lock-free SPSC ring. There is one ring per (egress, ingress) pair, and TX threads drain them by deficit round robin.
+
+Ports are split into thread groups: each group has one RX and one TX thread. One group per port gives every port its
+own threads, and a single group runs the whole data plane on two threads. RX threads sleep in epoll on their ports'
+descriptors (see PortPoller), so idle ports cost nothing.
+
+Build (from libraries/), with the host compat headers first on the include path:
+  g++ -O2 -pthread -fpermissive -DTOTAL_LINKS=32 -DSWITCH_LOOP_DELAY_MS=1 -Iuartnet_host/compat -Iuartnet_host
+      -Iuartnet -Iuartnet_link_layer -Iuartnet_link_layer_routing <sources> <your main> -lutil -lrt
+where the sources are uartnet_host/compat/arduino_compat.cpp, uartnet/switch.cpp, all .cpp files in uartnet_host and
+uartnet_link_layer_routing, and all .c and .cpp files in uartnet_link_layer.*/
+
+#ifndef _UARTNET_HOST_SWITCHH_
+#define _UARTNET_HOST_SWITCHH_
+
+#include <switch.h>
+#include "spsc_ring.h"
+#include "serial_port.h"
+
+#define HOST_IDLE_US		200			//How long an idle TX thread sleeps before polling its rings again
+#define HOST_POLL_MS		10			//Longest an RX thread blocks in epoll. Also bounds forwarding table updates
+
+
+typedef struct {
+  unsigned long rx_frames;				//Frames received on the port
+  unsigned long fwd_frames;				//Received frames forwarded by the data plane, without the control plane
+  unsigned long tx_frames;				//Frames transmitted on the port
+  unsigned long tx_bytes;
+  unsigned long drops;					//Received frames dropped: unreachable destination, or a full ring
+} HOST_PORT_STATS;
+
+
+//Starts the control plane and all data plane threads. The ports must already be open
+uint8_t host_switch_start(const SWITCH_PORT *ports, uint8_t count, uint8_t groups);
+void host_switch_stats(uint8_t port, HOST_PORT_STATS *stats);
+
+
+#endif
@@ -0,0 +1,67 @@
+#include "noisy_stream.h"
+
+
+NoisyStream::NoisyStream(Stream *inner_stream, double bit_error_rate, unsigned short seed)
+{
+  inner = inner_stream;
+  xsubi[0] = seed;
+  xsubi[1] = 0x330E;
+  xsubi[2] = 0x1234;
+  flipped = 0;
+  set_ber(bit_error_rate);
+}
+
+void NoisyStream::set_ber(double bit_error_rate)
+{
+  ber = bit_error_rate;
+  gap = next_gap();
+}
+
+uint64_t NoisyStream::next_gap()
+{
+  double u;
+
+  if (ber <= 0)
+    return UINT64_MAX;
+
+  //erand48() is in [0, 1), and log(0) is of no use
+  u = 1.0 - erand48(xsubi);
+  return (uint64_t)floor(log(u) / log(1.0 - ber));
+}
+
+size_t NoisyStream::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t NoisyStream::write(const uint8_t *buffer, size_t size)
+{
+  uint8_t chunk[NOISY_CHUNK_SIZE];
+  size_t sent = 0, n, written;
+  uint64_t bits, pos;
+
+  while (sent < size)
+  {
+    n = min(size - sent, (size_t)NOISY_CHUNK_SIZE);
+    memcpy(chunk, &buffer[sent], n);
+
+    bits = n * 8;
+    pos = 0;
+    while (gap < bits - pos)
+    {
+      pos += gap;
+      chunk[pos / 8] ^= 1 << (pos % 8);
+      flipped++;
+      pos++;
+      gap = next_gap();
+    }
+    gap -= bits - pos;
+
+    written = inner->write(chunk, n);
+    sent += written;
+    if (written < n)
+      break;
+  }
+
+  return sent;
+}
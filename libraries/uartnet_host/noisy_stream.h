@@ -0,0 +1,42 @@
+/*Stream that corrupts everything written through it at a given bit error rate, to test protocols against line
+noise. Flipped bits are spread uniformly: the gap to the next one is drawn from the geometric distribution. Reads
+pass through untouched, so wrap both ends of a line to make it noisy both ways.*/
+
+#ifndef _UARTNET_HOST_NOISY_STREAMH_
+#define _UARTNET_HOST_NOISY_STREAMH_
+
+#include "Arduino.h"
+
+#define NOISY_CHUNK_SIZE		256
+
+
+class NoisyStream : public Stream
+{
+  public:
+    NoisyStream(Stream *inner = NULL, double ber = 0, unsigned short seed = 1);
+
+    void set_ber(double ber);
+    unsigned long bits_flipped() { return flipped; }
+
+    int available() { return inner->available(); }
+    int read() { return inner->read(); }
+    int peek() { return inner->peek(); }
+    size_t readBytes(char *buffer, size_t length) { return inner->readBytes(buffer, length); }
+    int fd() { return inner->fd(); }
+
+    using Print::write;
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+
+  private:
+    uint64_t next_gap();
+
+    Stream *inner;
+    double ber;
+    uint64_t gap;					//Clean bits before the next flipped one
+    unsigned short xsubi[3];
+    unsigned long flipped;
+};
+
+
+#endif
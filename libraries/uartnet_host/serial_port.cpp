@@ -0,0 +1,151 @@
+#include "serial_port.h"
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+
+/******************************/
+//Serial ports
+/******************************/
+
+static speed_t baud_to_speed(unsigned long baud)
+{
+  switch (baud)
+  {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 500000: return B500000;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+    default: return B0;
+  }
+}
+
+
+uint8_t SerialPort::configure(int fd, unsigned long baud)
+{
+  struct termios tio;
+  speed_t speed = baud_to_speed(baud);
+
+  if (speed == B0)
+  {
+    printf("ERROR: Unsupported baud rate %lu\n", baud);
+    return 0;
+  }
+
+  if (tcgetattr(fd, &tio) < 0)
+    return 0;
+
+  //8N1, no flow control, no line discipline. Reads return whatever has arrived
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+
+  if (tcsetattr(fd, TCSANOW, &tio) < 0)
+    return 0;
+
+  tcflush(fd, TCIOFLUSH);
+  return 1;
+}
+
+
+uint8_t SerialPort::open(const char *path, unsigned long baud)
+{
+  int fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+  if (fd < 0)
+  {
+    printf("ERROR: Cannot open %s\n", path);
+    return 0;
+  }
+
+  if (!configure(fd, baud))
+  {
+    ::close(fd);
+    return 0;
+  }
+
+  close();
+  attach(fd);
+  return 1;
+}
+
+
+void SerialPort::close()
+{
+  if (my_fd >= 0)
+    ::close(my_fd);
+
+  my_fd = -1;
+  peeked = -1;
+}
+
+
+/******************************/
+//Readiness
+/******************************/
+
+PortPoller::PortPoller()
+{
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+
+PortPoller::~PortPoller()
+{
+  if (epfd >= 0)
+    ::close(epfd);
+}
+
+
+uint8_t PortPoller::add(Stream *port, uint8_t tag)
+{
+  return add(port->fd(), tag);
+}
+
+
+uint8_t PortPoller::add(int fd, uint8_t tag)
+{
+  struct epoll_event ev;
+
+  if (epfd < 0 || fd < 0)
+    return 0;
+
+  //Level triggered: a port whose bytes did not all fit in its rbuf is reported again
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = tag;
+
+  return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+
+int PortPoller::wait(uint8_t *ready, int max, int timeout_ms)
+{
+  struct epoll_event events[PORT_POLLER_MAX_EVENTS];
+  int n, i;
+
+  if (max > PORT_POLLER_MAX_EVENTS)
+    max = PORT_POLLER_MAX_EVENTS;
+
+  n = epoll_wait(epfd, events, max, timeout_ms);
+  if (n < 0)
+    return 0;
+
+  for (i = 0; i < n; i++)
+    ready[i] = events[i].data.u32;
+
+  return n;
+}
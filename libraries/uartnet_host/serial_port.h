@@ -0,0 +1,43 @@
+/*Serial device on a Linux host (/dev/tty*, or a pty), opened in raw mode through termios. A LINK runs on it like on
+one of the Mega's HardwareSerial ports. Its descriptor is non-blocking, so a PortPoller can wait on many at once.*/
+
+#ifndef _UARTNET_HOST_SERIAL_PORTH_
+#define _UARTNET_HOST_SERIAL_PORTH_
+
+#include "fd_stream.h"
+
+#define PORT_POLLER_MAX_EVENTS	32
+
+
+class SerialPort : public FdStream
+{
+  public:
+    //Returns 0 if the device cannot be opened or does not support the baud rate
+    uint8_t open(const char *path, unsigned long baud);
+    void close();
+
+    //Applies raw mode and the baud rate to any tty descriptor, e.g. the slave end of openpty()
+    static uint8_t configure(int fd, unsigned long baud);
+};
+
+
+//Readiness for a set of ports, through epoll. Each port is reported by the tag it was added with
+class PortPoller
+{
+  public:
+    PortPoller();
+    ~PortPoller();
+
+    //Returns 0 if the port has no descriptor (see Stream::fd()). Such ports have to be polled by the caller
+    uint8_t add(Stream *port, uint8_t tag);
+    uint8_t add(int fd, uint8_t tag);
+
+    //Waits up to timeout_ms (-1 for ever) for ports with bytes to read. Returns how many tags were stored into ready
+    int wait(uint8_t *ready, int max, int timeout_ms);
+
+  private:
+    int epfd;
+};
+
+
+#endif
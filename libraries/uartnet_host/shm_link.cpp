@@ -0,0 +1,207 @@
+#include "shm_link.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+ShmLink::ShmLink()
+{
+  region = NULL;
+  creator = 0;
+}
+
+
+ShmLink::~ShmLink()
+{
+  close();
+}
+
+
+uint8_t ShmLink::map(const char *name, uint8_t create, unsigned long baud)
+{
+  unsigned long start = millis();
+  int fd;
+
+  close();
+
+  fd = shm_open(name, create ? (O_CREAT | O_TRUNC | O_RDWR) : O_RDWR, 0600);
+  if (fd < 0)
+  {
+    printf("ERROR: Cannot open shared memory %s\n", name);
+    return 0;
+  }
+
+  if (create && ftruncate(fd, sizeof(SHM_LINK_REGION)) < 0)
+  {
+    ::close(fd);
+    return 0;
+  }
+
+  region = (SHM_LINK_REGION*)mmap(NULL, sizeof(SHM_LINK_REGION), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (region == MAP_FAILED)
+  {
+    region = NULL;
+    return 0;
+  }
+
+  if (create)
+  {
+    memset(region, 0, sizeof(SHM_LINK_REGION));
+    __atomic_store_n(&region->magic, SHM_LINK_MAGIC, __ATOMIC_RELEASE);
+  }
+  else
+  {
+    while (__atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) != SHM_LINK_MAGIC)
+    {
+      if (millis() - start > SHM_LINK_ATTACH_MS)
+      {
+        printf("ERROR: Shared memory %s is not a link\n", name);
+        close();
+        return 0;
+      }
+
+      usleep(SHM_LINK_WAIT_US);
+    }
+  }
+
+  creator = create;
+  strncpy(shm_name, name, SHM_LINK_NAME_SIZE - 1);
+  shm_name[SHM_LINK_NAME_SIZE - 1] = '\0';
+
+  tx = &region->ring[creator ? 0 : 1];
+  rx = &region->ring[creator ? 1 : 0];
+
+  //10 bits on the wire per byte
+  byte_ns = (baud > 0) ? 10000000000ULL / baud : 0;
+  line_free_ns = 0;
+
+  return 1;
+}
+
+
+uint8_t ShmLink::create(const char *name, unsigned long baud)
+{
+  return map(name, 1, baud);
+}
+
+
+uint8_t ShmLink::attach(const char *name, unsigned long baud)
+{
+  return map(name, 0, baud);
+}
+
+
+void ShmLink::close()
+{
+  if (region == NULL)
+    return;
+
+  munmap(region, sizeof(SHM_LINK_REGION));
+  region = NULL;
+
+  //The name goes away with the creator. An attached end keeps its mapping until it closes too
+  if (creator)
+    shm_unlink(shm_name);
+}
+
+
+/******************************/
+//Reading
+/******************************/
+
+int ShmLink::available()
+{
+  return (region == NULL) ? 0 : byte_ring_count(rx);
+}
+
+
+int ShmLink::read()
+{
+  uint8_t c;
+
+  if (region == NULL)
+    return -1;
+
+  return byte_ring_read(rx, &c, 1) ? c : -1;
+}
+
+
+int ShmLink::peek()
+{
+  return (region == NULL) ? -1 : byte_ring_peek(rx);
+}
+
+
+size_t ShmLink::readBytes(char *buffer, size_t length)
+{
+  return (region == NULL) ? 0 : byte_ring_read(rx, (uint8_t*)buffer, length);
+}
+
+
+/******************************/
+//Writing
+/******************************/
+
+//How many bytes the line can take right now without going over the baud rate
+uint32_t ShmLink::line_credit()
+{
+  uint64_t now = (uint64_t)micros() * 1000;
+  uint64_t burst = SHM_LINK_BURST * byte_ns;
+
+  if (byte_ns == 0)
+    return BYTE_RING_SIZE;
+
+  //An idle line does not save up credit beyond its burst
+  if (line_free_ns < now)
+    line_free_ns = now;
+
+  if (line_free_ns - now >= burst)
+    return 0;
+
+  return (burst - (line_free_ns - now)) / byte_ns;
+}
+
+
+size_t ShmLink::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+
+//Writes everything, waiting for the peer to make room and for the line to be free
+size_t ShmLink::write(const uint8_t *buffer, size_t size)
+{
+  unsigned long last_progress = millis();
+  size_t sent = 0;
+  uint32_t chunk, room, credit;
+
+  if (region == NULL)
+    return 0;
+
+  while (sent < size)
+  {
+    //min() is a macro, so each bound is taken once first
+    room = byte_ring_room(tx);
+    credit = line_credit();
+    chunk = min(size - sent, min(room, credit));
+
+    if (chunk == 0)
+    {
+      if (millis() - last_progress > SHM_LINK_STALL_MS)
+        break;
+
+      usleep(SHM_LINK_WAIT_US);
+      continue;
+    }
+
+    byte_ring_write(tx, &buffer[sent], chunk);
+    line_free_ns += chunk * byte_ns;
+    sent += chunk;
+    last_progress = millis();
+  }
+
+  return sent;
+}
@@ -0,0 +1,64 @@
+/*Virtual serial line between two processes, over shared memory: one SPSC byte ring per direction. It is a Stream, so
+a LINK runs on it wherever a HardwareSerial would do, with no system call per byte or frame.
+
+One end creates the line (usually the switch), the other attaches to it by name. Writes can be throttled to a baud
+rate, 8N1 like a UART, so timing-sensitive logic sees realistic line rates. With no baud rate the line runs as fast
+as the rings go.*/
+
+#ifndef _UARTNET_HOST_SHM_LINKH_
+#define _UARTNET_HOST_SHM_LINKH_
+
+#include "Arduino.h"
+#include "spsc_ring.h"
+
+#define SHM_LINK_MAGIC			0x55534D4CUL
+#define SHM_LINK_NAME_SIZE		64
+#define SHM_LINK_BURST			64			//Bytes a throttled line can take at once, like a UART's FIFO
+#define SHM_LINK_WAIT_US		50			//Pause while the ring is full or the line is busy
+#define SHM_LINK_STALL_MS		1000		//Give up on a write after this long without progress: the peer is gone
+#define SHM_LINK_ATTACH_MS		1000		//How long attach() waits for the creator to set the line up
+
+
+typedef struct {
+  BYTE_RING ring[2];						//ring[0] carries bytes from the creator, ring[1] towards it
+  uint32_t magic;							//Set by the creator once the rings are ready
+} SHM_LINK_REGION;
+
+
+class ShmLink : public Stream
+{
+  public:
+    ShmLink();
+    ~ShmLink();
+
+    //baud 0 leaves this end's writes unthrottled. Both return 0 on failure
+    uint8_t create(const char *name, unsigned long baud = 0);
+    uint8_t attach(const char *name, unsigned long baud = 0);
+    void close();
+
+    int available();
+    int read();
+    int peek();
+    size_t readBytes(char *buffer, size_t length);
+
+    using Print::write;
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+
+  private:
+    uint8_t map(const char *name, uint8_t creator, unsigned long baud);
+    uint32_t line_credit();
+
+    SHM_LINK_REGION *region;
+    BYTE_RING *rx;
+    BYTE_RING *tx;
+    uint8_t creator;
+    char shm_name[SHM_LINK_NAME_SIZE];
+
+    //Throttling. The line is busy until line_free_ns with what was already written
+    uint64_t byte_ns;
+    uint64_t line_free_ns;
+};
+
+
+#endif
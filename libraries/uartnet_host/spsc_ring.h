@@ -0,0 +1,139 @@
+/*Lock-free single-producer/single-consumer rings for handing data between host threads.
+Exactly one thread may push into a ring, and exactly one other thread may pop from it. Byte rings hold no pointers,
+so they also work between processes, in shared memory (see ShmLink).*/
+
+#ifndef _UARTNET_HOST_SPSC_RINGH_
+#define _UARTNET_HOST_SPSC_RINGH_
+
+#include <frame.h>
+
+#define CACHE_LINE_SIZE		64
+#define FRAME_RING_SIZE		32			//Must be a power of two
+#define BYTE_RING_SIZE		4096		//Must be a power of two
+
+
+//Ring of raw frame descriptors. The frame buffers themselves move between threads by pointer
+typedef struct {
+  uint32_t head;									//Next slot to pop. Only written by the consumer
+  uint8_t pad0[CACHE_LINE_SIZE - sizeof(uint32_t)];
+  uint32_t tail;									//Next slot to push. Only written by the producer
+  uint8_t pad1[CACHE_LINE_SIZE - sizeof(uint32_t)];
+  RAW_FRAME slot[FRAME_RING_SIZE];
+} FRAME_RING;
+
+
+//Ring of bytes, for streams that are framed by the reader
+typedef struct {
+  uint32_t head;
+  uint8_t pad0[CACHE_LINE_SIZE - sizeof(uint32_t)];
+  uint32_t tail;
+  uint8_t pad1[CACHE_LINE_SIZE - sizeof(uint32_t)];
+  uint8_t buf[BYTE_RING_SIZE];
+} BYTE_RING;
+
+
+/*******************************
+Frame rings
+*******************************/
+
+//Producer only. Returns 0 if the ring is full
+inline uint8_t frame_ring_push(FRAME_RING *ring, RAW_FRAME raw)
+{
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+  if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == FRAME_RING_SIZE)
+    return 0;
+
+  ring->slot[tail & (FRAME_RING_SIZE - 1)] = raw;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+
+//Consumer only. Look at the oldest frame without taking it. Returns 0 if the ring is empty
+inline uint8_t frame_ring_peek(FRAME_RING *ring, RAW_FRAME *raw)
+{
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+  if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+    return 0;
+
+  *raw = ring->slot[head & (FRAME_RING_SIZE - 1)];
+  return 1;
+}
+
+
+//Consumer only. Drop the frame returned by the last frame_ring_peek()
+inline void frame_ring_pop(FRAME_RING *ring)
+{
+  __atomic_store_n(&ring->head, __atomic_load_n(&ring->head, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+}
+
+
+/*******************************
+Byte rings
+*******************************/
+
+//Consumer only
+inline uint32_t byte_ring_count(BYTE_RING *ring)
+{
+  return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+}
+
+
+//Producer only. Bytes that can be written right now
+inline uint32_t byte_ring_room(BYTE_RING *ring)
+{
+  return BYTE_RING_SIZE - (__atomic_load_n(&ring->tail, __ATOMIC_RELAXED) - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE));
+}
+
+
+//Producer only. All or nothing, so a frame is never split by a full ring
+inline uint8_t byte_ring_write(BYTE_RING *ring, const uint8_t *buf, uint32_t size)
+{
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  uint32_t i;
+
+  if (BYTE_RING_SIZE - (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) < size)
+    return 0;
+
+  for (i = 0; i < size; i++)
+    ring->buf[(tail + i) & (BYTE_RING_SIZE - 1)] = buf[i];
+
+  __atomic_store_n(&ring->tail, tail + size, __ATOMIC_RELEASE);
+  return 1;
+}
+
+
+//Consumer only. Next byte without taking it, -1 if the ring is empty
+inline int byte_ring_peek(BYTE_RING *ring)
+{
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+  if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+    return -1;
+
+  return ring->buf[head & (BYTE_RING_SIZE - 1)];
+}
+
+
+//Consumer only. Returns how many bytes were read
+inline uint32_t byte_ring_read(BYTE_RING *ring, uint8_t *buf, uint32_t size)
+{
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  uint32_t count = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - head;
+  uint32_t i;
+
+  if (size > count)
+    size = count;
+
+  for (i = 0; i < size; i++)
+    buf[i] = ring->buf[(head + i) & (BYTE_RING_SIZE - 1)];
+
+  __atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+  return size;
+}
+
+
+#endif
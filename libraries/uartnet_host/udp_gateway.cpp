@@ -0,0 +1,249 @@
+#include "udp_gateway.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+
+uint8_t UdpGateway::begin(Stream *uart, const uint8_t *id_list, uint8_t count, uint16_t base_port)
+{
+  struct sockaddr_in addr;
+  uint8_t i;
+
+  if (count == 0 || count > MAX_ADDRESS)
+    return 0;
+
+  link_init(uart, id_list[0], ENDPOINT, &link);
+  poller.add(uart, UDP_GW_UART_TAG);
+
+  total_ids = count;
+  out_count = 0;
+  memset(has_service, 0, sizeof(has_service));
+  memset(&my_stats, 0, sizeof(my_stats));
+
+  for (i = 0; i < total_ids; i++)
+  {
+    ids[i] = id_list[i];
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(base_port + ids[i]);
+
+    socks[i] = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socks[i] < 0 || bind(socks[i], (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+      printf("ERROR: Cannot bind UDP port %u for node %u\n", base_port + ids[i], ids[i]);
+      return 0;
+    }
+
+    poller.add(socks[i], i);
+
+    //Announce each id as it is added, since the send queue cannot hold them all
+    send_hello(ids[i], 0, &link);
+    send_join_msg(ids[i], &link);
+    while (transmit_next(&link));
+  }
+
+  last_hello = millis();
+  return 1;
+}
+
+
+/******************************/
+//UDP -> uartnet
+/******************************/
+
+void UdpGateway::from_udp(uint8_t idx)
+{
+  struct mmsghdr msgs[UDP_GW_BATCH];
+  struct iovec iov[UDP_GW_BATCH];
+  struct sockaddr_in from[UDP_GW_BATCH];
+  RAW_FRAME raw;
+  size_t len = 0, size;
+  unsigned long arrived, waited;
+  int n, i;
+
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < UDP_GW_BATCH; i++)
+  {
+    iov[i].iov_base = in_buf[i];
+    iov[i].iov_len = sizeof(in_buf[i]);
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &from[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+  }
+
+  n = recvmmsg(socks[idx], msgs, UDP_GW_BATCH, MSG_DONTWAIT, NULL);
+  if (n <= 0)
+    return;
+
+  arrived = micros();
+  my_stats.batches++;
+
+  for (i = 0; i < n; i++)
+  {
+    size = msgs[i].msg_len;
+
+    //[dst][payload], where dst is a node or MAX_ADDRESS for a broadcast
+    if (size < 1 || size > MAX_PAYLOAD_SIZE + 1 || in_buf[i][0] == 0 || in_buf[i][0] > MAX_ADDRESS)
+    {
+      my_stats.drops++;
+      continue;
+    }
+
+    service[idx] = from[i];
+    has_service[idx] = 1;
+
+    raw = frame_to_raw(create_frame(ids[idx], in_buf[i][0], size - 1, &in_buf[i][1]));
+    memcpy(&tx_buf[len], raw.buf, raw.size);
+    len += raw.size;
+    free(raw.buf);
+
+    my_stats.to_net_frames++;
+    my_stats.to_net_bytes += size - 1;
+  }
+
+  if (len == 0)
+    return;
+
+  link.port->write(tx_buf, len);
+
+  //Same 1/8 gain as the link's smoothed RTT
+  waited = micros() - arrived;
+  my_stats.lat_avg_us += ((long)waited - (long)my_stats.lat_avg_us) / 8;
+  if (waited > my_stats.lat_max_us)
+    my_stats.lat_max_us = waited;
+}
+
+
+/******************************/
+//uartnet -> UDP
+/******************************/
+
+void UdpGateway::flush_udp()
+{
+  struct mmsghdr msgs[UDP_GW_BATCH];
+  struct iovec iov[UDP_GW_BATCH];
+  int i;
+
+  if (out_count == 0)
+    return;
+
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < out_count; i++)
+  {
+    iov[i].iov_base = out_buf[i];
+    iov[i].iov_len = out_size[i];
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &service[out_idx];
+    msgs[i].msg_hdr.msg_namelen = sizeof(service[out_idx]);
+  }
+
+  //Datagrams the socket has no room for are lost, as they would be on the wire
+  i = sendmmsg(socks[out_idx], msgs, out_count, MSG_DONTWAIT);
+  if (i < 0)
+    i = 0;
+
+  my_stats.batches++;
+  my_stats.drops += out_count - i;
+  out_count = 0;
+}
+
+
+void UdpGateway::deliver(RAW_FRAME raw)
+{
+  uint8_t src = raw.buf[2] & 0x0F;
+  uint8_t dst = (uint8_t)raw.buf[2] >> 4;
+  uint8_t size = raw.buf[3];
+  uint8_t idx;
+
+  for (idx = 0; idx < total_ids; idx++)
+    if (ids[idx] == dst)
+      break;
+
+  if (idx == total_ids || !has_service[idx])
+  {
+    my_stats.drops++;
+    return;
+  }
+
+  if (out_count == UDP_GW_BATCH || (out_count > 0 && out_idx != idx))
+    flush_udp();
+
+  out_idx = idx;
+  out_buf[out_count][0] = src;
+  memcpy(&out_buf[out_count][1], &raw.buf[FRAME_HEADER_SIZE + 1], size);
+  out_size[out_count++] = size + 1;
+
+  my_stats.to_udp_frames++;
+  my_stats.to_udp_bytes += size;
+}
+
+
+void UdpGateway::from_uart()
+{
+  RAW_FRAME raw;
+  FRAME frame;
+
+  if (check_new_bytes(&link) == 0 && !link.rbuf_valid)
+    return;
+
+  raw = extract_frame_from_rbuf(&link);
+  while (raw.size > 0)
+  {
+    if (RAW_ABORTED(raw))
+      my_stats.drops++;
+
+    else if (*((uint16_t*)&raw.buf[0]) == MFRAME_PREAMBLE)
+      deliver(raw);
+
+    else if (*((uint16_t*)&raw.buf[0]) == CFRAME_PREAMBLE)
+    {
+      frame = raw_to_frame(raw);
+      parse_control_frame(frame, &link);
+      free(frame.payload);
+    }
+
+    free(raw.buf);
+    proc_buf(NULL, 0, &link);
+    raw = extract_frame_from_rbuf(&link);
+  }
+
+  flush_udp();
+}
+
+
+/******************************/
+//main
+/******************************/
+
+void UdpGateway::task(int timeout_ms)
+{
+  uint8_t ready[MAX_ADDRESS + 1];
+  uint8_t i;
+  int n;
+
+  n = poller.wait(ready, total_ids + 1, timeout_ms);
+
+  while (n > 0)
+  {
+    if (ready[--n] == UDP_GW_UART_TAG)
+      from_uart();
+    else
+      from_udp(ready[n]);
+  }
+
+  if (millis() - last_hello >= UDP_GW_HELLO_MS)
+  {
+    last_hello = millis();
+    for (i = 0; i < total_ids; i++)
+      send_hello(ids[i], 0, &link);
+  }
+
+  //Control frames queued by the link layer
+  while (transmit_next(&link));
+}
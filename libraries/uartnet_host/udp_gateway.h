@@ -0,0 +1,76 @@
+/*Gateway between a uartnet network and UDP services on the same host.
+
+The gateway is an endpoint on one switch port (any Stream: a SerialPort to a Mega switch, or a pty of a host switch)
+and joins the network under a set of virtual node ids. Each id has a UDP socket bound to 127.0.0.1:base_port + id.
+  - A datagram sent to an id's socket is [dst][payload], and goes out as a message from that id to dst.
+  - A message to an id comes back as a datagram [src][payload], sent to whoever last used the id's socket.
+Datagrams are taken and delivered UDP_GW_BATCH at a time with recvmmsg()/sendmmsg(), and each batch goes to the UART
+in a single write.*/
+
+#ifndef _UARTNET_HOST_UDP_GATEWAYH_
+#define _UARTNET_HOST_UDP_GATEWAYH_
+
+#include <link.h>
+#include <routing.h>
+#include "serial_port.h"
+
+#include <netinet/in.h>
+
+#define UDP_GW_BASE_PORT		47000
+#define UDP_GW_BATCH			16			//Datagrams per system call
+#define UDP_GW_HELLO_MS			1000		//How often each virtual id says HELLO, so the switch keeps it alive
+#define UDP_GW_UART_TAG			0xFF		//PortPoller tag of the UART. Sockets are tagged by their index in ids
+
+
+typedef struct {
+  unsigned long to_net_frames;			//Datagrams sent on as frames
+  unsigned long to_net_bytes;			//Payload bytes
+  unsigned long to_udp_frames;			//Frames delivered as datagrams
+  unsigned long to_udp_bytes;
+  unsigned long drops;					//Malformed datagrams, aborted frames, or ids no service has used yet
+  unsigned long batches;				//recvmmsg()/sendmmsg() calls
+  unsigned long lat_avg_us;				//Smoothed time from a datagram's arrival until its frame is on the UART
+  unsigned long lat_max_us;
+} UDP_GW_STATS;
+
+
+class UdpGateway
+{
+  public:
+    //Binds a socket per id, then sends HELLO and JOIN for each. Returns 0 if a socket cannot be bound
+    uint8_t begin(Stream *uart, const uint8_t *ids, uint8_t count, uint16_t base_port = UDP_GW_BASE_PORT);
+
+    //Handles whatever is ready, waiting up to timeout_ms for something to be
+    void task(int timeout_ms);
+
+    void stats(UDP_GW_STATS *out) { memcpy(out, &my_stats, sizeof(UDP_GW_STATS)); }
+
+  private:
+    void from_udp(uint8_t idx);
+    void from_uart();
+    void deliver(RAW_FRAME raw);
+    void flush_udp();
+
+    LINK link;
+    PortPoller poller;
+    uint8_t total_ids;
+    uint8_t ids[MAX_ADDRESS];
+    int socks[MAX_ADDRESS];
+    struct sockaddr_in service[MAX_ADDRESS];		//Last sender on each id's socket. Replies go there
+    uint8_t has_service[MAX_ADDRESS];
+    unsigned long last_hello;
+
+    //Datagrams waiting for sendmmsg(). All of them go out on socks[out_idx]
+    uchar out_buf[UDP_GW_BATCH][MAX_PAYLOAD_SIZE + 1];
+    size_t out_size[UDP_GW_BATCH];
+    uint8_t out_count;
+    uint8_t out_idx;
+
+    uchar in_buf[UDP_GW_BATCH][MAX_PAYLOAD_SIZE + 2];
+    uchar tx_buf[UDP_GW_BATCH * (FRAME_HEADER_SIZE + MAX_PAYLOAD_SIZE + 2)];
+
+    UDP_GW_STATS my_stats;
+};
+
+
+#endif
@@ -0,0 +1,254 @@
+#include "fec.h"
+
+//GF(256) over x^8 + x^4 + x^3 + x^2 + 1, generated by alpha = 2. Multiplying is adding logs, so every kernel below is
+//a few table lookups per byte. The tables take 512 bytes of RAM, and are built once instead of taking flash
+#define GF_POLY			0x11D
+
+static uint8_t gf_exp[255];
+static uint8_t gf_log[256];
+static uint8_t gen_log[FEC_PARITY];		//Logs of the generator's coefficients, highest power first
+static uint8_t fec_ready = 0;
+
+
+//alpha^(log_a + log_b)
+static inline uint8_t gf_exp_sum(uint16_t log_a, uint16_t log_b)
+{
+	log_a += log_b;
+	if(log_a >= 255)
+		log_a -= 255;
+
+	return gf_exp[log_a];
+}
+
+
+static inline uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+	if(a == 0 || b == 0)
+		return 0;
+
+	return gf_exp_sum(gf_log[a], gf_log[b]);
+}
+
+
+static inline uint8_t gf_div(uint8_t a, uint8_t b)
+{
+	if(a == 0)
+		return 0;
+
+	return gf_exp_sum(gf_log[a], 255 - gf_log[b]);
+}
+
+
+void fec_init()
+{
+	uint8_t gen[FEC_PARITY + 1];
+	uint16_t x = 1;
+	uint8_t i, j;
+
+	if(fec_ready)
+		return;
+
+	for(i = 0; i < 255; i++)
+	{
+		gf_exp[i] = x;
+		gf_log[x] = i;
+
+		x <<= 1;
+		if(x & 0x100)
+			x ^= GF_POLY;
+	}
+
+	//g(x) = (x - alpha^0)(x - alpha^1)...(x - alpha^(FEC_PARITY-1)). gen[j] is the coefficient of x^j
+	memset(gen, 0, sizeof(gen));
+	gen[0] = 1;
+	for(i = 0; i < FEC_PARITY; i++)
+	{
+		for(j = i + 1; j > 0; j--)
+			gen[j] = gen[j - 1] ^ gf_mul(gen[j], gf_exp[i]);
+		gen[0] = gf_mul(gen[0], gf_exp[i]);
+	}
+
+	//All of them are non-zero
+	for(j = 0; j < FEC_PARITY; j++)
+		gen_log[j] = gf_log[gen[FEC_PARITY - 1 - j]];
+
+	fec_ready = 1;
+}
+
+
+//Systematic encoding: the parity is the remainder of data(x) * x^FEC_PARITY divided by g(x), worked out by an LFSR
+static void fec_encode_block(const uchar *data, uint8_t size, uchar *parity)
+{
+	uint8_t i, j, feedback;
+	uint16_t log_fb;
+
+	memset(parity, 0, FEC_PARITY);
+
+	for(i = 0; i < size; i++)
+	{
+		feedback = data[i] ^ parity[0];
+		log_fb = gf_log[feedback];
+
+		for(j = 0; j < FEC_PARITY - 1; j++)
+			parity[j] = parity[j + 1] ^ (feedback ? gf_exp_sum(log_fb, gen_log[j]) : 0);
+		parity[FEC_PARITY - 1] = feedback ? gf_exp_sum(log_fb, gen_log[FEC_PARITY - 1]) : 0;
+	}
+}
+
+
+size_t fec_encode(const uchar *raw, size_t size, uchar *wire)
+{
+	uint16_t preamble = *((uint16_t*)&raw[0]);
+	size_t in = FRAME_HEADER_SIZE, out = FEC_HEADER_WIRE;
+	uint8_t chunk;
+
+	//The header block
+	memcpy(wire, raw, FRAME_HEADER_SIZE);
+	preamble = FEC_PREAMBLE(preamble);
+	memcpy(wire, &preamble, 2);
+	fec_encode_block(wire, FRAME_HEADER_SIZE, &wire[FRAME_HEADER_SIZE]);
+
+	//STX, payload and ETX
+	while(in < size)
+	{
+		chunk = (size - in < FEC_BLOCK_SIZE) ? size - in : FEC_BLOCK_SIZE;
+
+		memcpy(&wire[out], &raw[in], chunk);
+		fec_encode_block(&wire[out], chunk, &wire[out + chunk]);
+
+		in += chunk;
+		out += chunk + FEC_PARITY;
+	}
+
+	return out;
+}
+
+
+//Berlekamp-Massey finds the error locator from the syndromes, a Chien search finds its roots, i.e. where the errors
+//are, and Forney's formula how far off each byte is. Only blocks with a non-zero syndrome get past the first loop
+int fec_decode_block(uchar *block, uint8_t size)
+{
+	uint8_t synd[FEC_PARITY];
+	uint8_t lambda[FEC_PARITY + 1], prev[FEC_PARITY + 1], temp[FEC_PARITY + 1], omega[FEC_PARITY];
+	uint8_t n = size + FEC_PARITY;
+	uint8_t i, j, k, errors = 0, order = 0, shift = 1, delta, last_delta = 1, bad = 0;
+	uint8_t x_inv, sum, numerator, denominator;
+	uint16_t power;
+
+	//Syndromes: the received block evaluated at each root of g(x), by Horner's rule. The first byte is the highest power
+	memset(synd, 0, FEC_PARITY);
+	for(i = 0; i < n; i++)
+		for(j = 0; j < FEC_PARITY; j++)
+			synd[j] = (synd[j] ? gf_exp_sum(gf_log[synd[j]], j) : 0) ^ block[i];
+
+	for(j = 0; j < FEC_PARITY; j++)
+		bad |= synd[j];
+	if(!bad)
+		return 0;
+
+	memset(lambda, 0, sizeof(lambda));
+	memset(prev, 0, sizeof(prev));
+	lambda[0] = prev[0] = 1;
+
+	for(k = 0; k < FEC_PARITY; k++)
+	{
+		delta = synd[k];
+		for(i = 1; i <= order; i++)
+			delta ^= gf_mul(lambda[i], synd[k - i]);
+
+		if(delta == 0)
+		{
+			shift++;
+			continue;
+		}
+
+		memcpy(temp, lambda, sizeof(lambda));
+		for(i = shift; i <= FEC_PARITY; i++)
+			lambda[i] ^= gf_mul(gf_div(delta, last_delta), prev[i - shift]);
+
+		if(2 * order <= k)
+		{
+			order = k + 1 - order;
+			memcpy(prev, temp, sizeof(prev));
+			last_delta = delta;
+			shift = 1;
+		}
+		else
+			shift++;
+	}
+
+	if(order > FEC_PARITY / 2)
+		return -1;
+
+	//omega(x) = synd(x) * lambda(x) mod x^FEC_PARITY
+	for(k = 0; k < FEC_PARITY; k++)
+	{
+		omega[k] = 0;
+		for(i = 0; i <= k && i <= order; i++)
+			omega[k] ^= gf_mul(lambda[i], synd[k - i]);
+	}
+
+	//Byte i stands for x^(n-1-i). It is wrong if lambda(alpha^-(n-1-i)) = 0
+	for(i = 0; i < n; i++)
+	{
+		power = n - 1 - i;
+		x_inv = gf_exp[(255 - power) % 255];
+
+		sum = 0;
+		for(k = 0; k <= order; k++)
+			sum ^= gf_mul(lambda[k], gf_exp[(uint16_t)gf_log[x_inv] * k % 255]);
+		if(sum != 0)
+			continue;
+
+		//Forney, for roots starting at alpha^0: error = X * omega(X^-1) / lambda'(X^-1)
+		numerator = 0;
+		for(k = 0; k < FEC_PARITY; k++)
+			numerator ^= gf_mul(omega[k], gf_exp[(uint16_t)gf_log[x_inv] * k % 255]);
+
+		denominator = 0;
+		for(k = 1; k <= order; k += 2)
+			denominator ^= gf_mul(lambda[k], gf_exp[(uint16_t)gf_log[x_inv] * (k - 1) % 255]);
+
+		if(denominator == 0)
+			return -1;
+
+		block[i] ^= gf_mul(gf_exp[power], gf_div(numerator, denominator));
+		errors++;
+	}
+
+	//Fewer roots than the locator's degree: more errors than it could see
+	if(errors != order)
+		return -1;
+
+	return errors;
+}
+
+
+int fec_decode(uchar *wire, uchar *raw)
+{
+	uint8_t size = wire[3];
+	uint16_t preamble = PLAIN_PREAMBLE(*((uint16_t*)&wire[0]));
+	size_t in = FEC_HEADER_WIRE, out = FRAME_HEADER_SIZE, total = FRAME_HEADER_SIZE + size + 2;
+	uint8_t chunk;
+	int fixed, errors = 0;
+
+	memcpy(raw, wire, FRAME_HEADER_SIZE);
+	memcpy(raw, &preamble, 2);
+
+	while(out < total)
+	{
+		chunk = (total - out < FEC_BLOCK_SIZE) ? total - out : FEC_BLOCK_SIZE;
+
+		fixed = fec_decode_block(&wire[in], chunk);
+		if(fixed < 0)
+			errors = -1;
+		else if(errors >= 0)
+			errors += fixed;
+
+		memcpy(&raw[out], &wire[in], chunk);
+		in += chunk + FEC_PARITY;
+		out += chunk;
+	}
+
+	return errors;
+}
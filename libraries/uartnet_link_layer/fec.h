@@ -0,0 +1,68 @@
+/*Forward error correction for noisy lines.
+
+A link with FEC on sends each frame as shortened Reed-Solomon codewords over GF(256), instead of retransmitting
+whatever the line corrupts. The frame header (preamble, addresses, size) goes first, as a block of its own, so the
+receiver learns how long the frame is before the rest arrives. The rest (STX, payload, ETX) follows in blocks of
+FEC_BLOCK_SIZE bytes, each one followed by FEC_PARITY parity bytes:
+
+  [header][parity] [STX payload...][parity] [...payload ETX][parity]
+
+Every block corrects up to FEC_PARITY / 2 bad bytes in place, wherever they are in it. FEC frames use the preamble of
+the frame they carry with its letter in lower case, so receivers tell them apart without any state, and hand the
+upper layers the plain frame. A frame with a block beyond repair ends with ABORT, and is dropped like an aborted one.*/
+
+#ifndef _UARTNET_FECH_
+#define _UARTNET_FECH_
+
+#include "frame.h"
+
+#ifndef FEC_PARITY
+#define FEC_PARITY					4			//Parity bytes per block
+#endif
+#ifndef FEC_BLOCK_SIZE
+#define FEC_BLOCK_SIZE				64			//Frame bytes per block. The last one is usually short
+#endif
+
+#if FEC_PARITY < 2 || FEC_PARITY > 16 || FEC_PARITY % 2 != 0
+#error "FEC_PARITY must be even, from 2 to 16"
+#endif
+#if FEC_BLOCK_SIZE + FEC_PARITY > 255
+#error "A FEC block does not fit a Reed-Solomon codeword"
+#endif
+
+//Preambles of FEC frames: 'm', 'c' and 'g' instead of 'M', 'C' and 'G'
+#define FEC_PREAMBLE(preamble)		((preamble) | 0x20)
+#define PLAIN_PREAMBLE(preamble)	((preamble) & ~0x20)
+#define IS_FEC_PREAMBLE(preamble)	((preamble) == FEC_PREAMBLE(MFRAME_PREAMBLE) || (preamble) == FEC_PREAMBLE(CFRAME_PREAMBLE) || \
+									 (preamble) == FEC_PREAMBLE(GFRAME_PREAMBLE))
+
+//Bytes on the line
+#define FEC_HEADER_WIRE				(FRAME_HEADER_SIZE + FEC_PARITY)
+#define FEC_BLOCKS(payload_size)	(((payload_size) + 2 + FEC_BLOCK_SIZE - 1) / FEC_BLOCK_SIZE)
+#define FEC_WIRE_SIZE(payload_size)	(FEC_HEADER_WIRE + (payload_size) + 2 + FEC_BLOCKS(payload_size) * FEC_PARITY)
+#define FEC_WIRE_MAX				FEC_WIRE_SIZE(MAX_PAYLOAD_SIZE)
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Builds the GF(256) tables. Called by link_init()
+void fec_init();
+
+//Encodes a raw frame for the line. wire must have room for FEC_WIRE_SIZE() of its payload. Returns the bytes written
+size_t fec_encode(const uchar *raw, size_t size, uchar *wire);
+
+//Corrects a block in place. Returns how many bytes were wrong, or -1 if there were more than it could correct
+int fec_decode_block(uchar *block, uint8_t size);
+
+//Turns a complete FEC frame, whose header block fec_decode_block() already checked, back into the raw frame. The
+//wire blocks are corrected in place. Returns how many bytes were wrong, or -1 if a block was beyond repair
+int fec_decode(uchar *wire, uchar *raw);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -47,12 +47,28 @@ FRAME create_cframe(uint8_t src, uint8_t dst, uint8_t size, uchar *payload)
 }
 
 
+FRAME create_gframe(uint8_t src, uint8_t group, uint8_t size, uchar *payload)
+{
+	FRAME frame;
+	
+	frame.preamble = GFRAME_PREAMBLE;
+	frame.src = src;
+	frame.dst = group;
+	frame.size = size;
+ 
+	frame.payload = payload;
+	
+	return frame;
+}
+
+
 //Turns a structured FRAME into a RAW_FRAME for transmission
 RAW_FRAME frame_to_raw (FRAME frame)
 {
   RAW_FRAME raw_frame;
   raw_frame.size = FRAME_HEADER_SIZE + frame.size + 2;  //header size + payload size + "STX" + "ETX"
-  raw_frame.buf = malloc(raw_frame.size);
+  raw_frame.buf = malloc(raw_frame.size + RAW_SPARE_SIZE);
+  raw_frame.refs = NULL;
   
   //Marshal the headers first 
   memcpy(raw_frame.buf, (uchar*)&frame, FRAME_HEADER_SIZE);
@@ -66,6 +82,25 @@ RAW_FRAME frame_to_raw (FRAME frame)
 }
 
 
+//Hand the same buffer to several send queues. The reference count lives in the spare byte past the frame,
+//so sharing costs no extra allocation. Every holder calls raw_release() when done
+void raw_share(RAW_FRAME *raw, uint8_t copies)
+{
+	raw->refs = &raw->buf[raw->size];
+	*raw->refs = copies;
+}
+
+
+//Drop one reference to the buffer, freeing it with the last one
+void raw_release(RAW_FRAME raw)
+{
+	if(raw.refs != NULL && --(*raw.refs) > 0)
+		return;
+	
+	free(raw.buf);
+}
+
+
 //Turn a RAW_FRAME into a FRAME struct. 
 FRAME raw_to_frame(RAW_FRAME raw)
 {
@@ -80,6 +115,7 @@ FRAME raw_to_frame(RAW_FRAME raw)
  
  
 	//create a new buffer for the payload
+	frame.payload = NULL;
 	if(frame.size > 0)
 	{
 		frame.payload = malloc(frame.size);
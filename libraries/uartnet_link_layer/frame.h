@@ -11,11 +11,16 @@ typedef unsigned char uchar;
 //Link Layer Frames
 #define MFRAME_PREAMBLE         	0x81CD      //SOH + M	(Used for Messages)
 #define CFRAME_PREAMBLE				0x81C3		//SOH + C	(Used for Network Control)
+#define GFRAME_PREAMBLE				0x81C7		//SOH + G	(Used for Multicast. dst holds a group instead of a node)
 
 //"Start of Text" and "End of Text" ASCII character that wraps around payload
 #define STX 0x2   
 #define ETX 0x3
 
+//"Cancel" ASCII character. Ends a frame in place of ETX when a switch already cut part of it through, then found it corrupt
+#define ABORT 0x18
+#define RAW_ABORTED(raw)			((raw).buf[(raw).size - 1] == ABORT)
+
 //bit widths for all packet header fields that are shared across all packet types
 #define PREAMBLE_WIDTH				16
 #define ADDRESS_WIDTH 				4 
@@ -23,10 +28,11 @@ typedef unsigned char uchar;
 #define CHECKSUM_WIDTH				8
 
 //maximum numerical values support by user configurable header fields
-#define MAX_ADDRESS					(1 << ADDRESS_WIDTH) - 1 
-#define MAX_PAYLOAD_SIZE			(1 << PAYLOAD_SIZE_WIDTH) - 1 
-#define MAX_STREAM_SIZE				(1 << STREAM_SIZE_WIDTH) - 1 
-#define MAX_ID						(1 << ID_WIDTH) - 1 
+#define MAX_ADDRESS					((1 << ADDRESS_WIDTH) - 1)
+#define MAX_PAYLOAD_SIZE			((1 << PAYLOAD_SIZE_WIDTH) - 1)
+#define MAX_STREAM_SIZE				((1 << STREAM_SIZE_WIDTH) - 1)
+#define MAX_ID						((1 << ID_WIDTH) - 1)
+#define MAX_GROUPS					(1 << ADDRESS_WIDTH)
 
 //Header size of the frame in bytes
 #define FRAME_HEADER_SIZE			(PREAMBLE_WIDTH + 2*ADDRESS_WIDTH + PAYLOAD_SIZE_WIDTH) /8
@@ -46,14 +52,18 @@ typedef struct {
 } __attribute__((packed)) FRAME;
 
 
-//buffer for a raw unprocessed frame
+//buffer for a raw unprocessed frame. Buffers can be shared by several send queues, see raw_share()
 typedef struct{
 
   size_t size;
   uchar *buf;
+  uint8_t *refs;		//Queues still holding buf. NULL while it has a single owner
 
 }RAW_FRAME;
 
+//Every raw buffer is allocated with this many spare bytes past the frame, to hold its reference count once shared
+#define RAW_SPARE_SIZE				1
+
 
 //Functions
 
@@ -68,9 +78,12 @@ void print_frame(FRAME frame);
 
 FRAME create_frame(uint8_t src, uint8_t dst, uint8_t size, uchar *payload);
 FRAME create_cframe(uint8_t src, uint8_t dst, uint8_t size, uchar *payload);
+FRAME create_gframe(uint8_t src, uint8_t group, uint8_t size, uchar *payload);
 FRAME buf_to_frame(uchar* buf);
 RAW_FRAME frame_to_raw (FRAME frame);
 FRAME raw_to_frame(RAW_FRAME raw);
+void raw_share(RAW_FRAME *raw, uint8_t copies);
+void raw_release(RAW_FRAME raw);
 
 
 
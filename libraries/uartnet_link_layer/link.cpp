@@ -1,4 +1,4 @@
-/*This file must be declared as a .cpp file since it uses the HardwareSerial Object from Arduino's library*/
+/*This file must be declared as a .cpp file since it uses the Stream Object from Arduino's library*/
 #include "link.h"
 
 
@@ -6,7 +6,7 @@
 Initialization
 *******************************/
 
-void link_init(HardwareSerial *port, uint8_t my_id, LINK_TYPE link_type, LINK *link)
+void link_init(Stream *port, uint8_t my_id, LINK_TYPE link_type, LINK *link)
 {
   link->port = port;
   link->link_type = link_type;
@@ -20,24 +20,43 @@ void link_init(HardwareSerial *port, uint8_t my_id, LINK_TYPE link_type, LINK *l
   link->rqueue_head = 0;
   link->squeue_pending = 0;
   link->squeue_lastsent = 0;
-  link->rtable_entries = 0;
+  memset(link->rtable_live, 0, sizeof(link->rtable_live));
+  link->rt_version = 0;
+  link->rt_sent_version = 0;
+  link->groups = 0;
+  link->ctrl_bytes_sent = 0;
+  link->mcast_bytes_pruned = 0;
+  link->fec_wanted = 0;
+  link->fec_peer = 0;
+  link->fec_on = 0;
+  link->fec_corrected = 0;
+  link->fec_failed = 0;
 
   
   memset(link->recvbuf, 0, RECV_BUFFER_SIZE);
   memset(link->recv_queue, 0, RECV_QUEUE_SIZE * sizeof(FRAME));
   memset(link->send_queue, 0, SEND_QUEUE_SIZE * sizeof(RAW_FRAME));
+  memset(link->handlers, 0, sizeof(link->handlers));
+  memset(link->handler_count, 0, sizeof(link->handler_count));
   
-  //memset(link.rtable, 0, RTABLE_LENGTH * sizeof(NODE));
-  for(int i=0; i<RTABLE_LENGTH; i++ )
-  {
-	link->rtable[i].hops = 0;
-	link->rtable[i].rtt = 0;
-	link->rtable[i].ticks = 0;
-	link->rtable[i].last_ping_recvd = 0;
-	link->rtable[i].last_ping_sent = 0;
-  }
+  memset(link->rtable, 0, sizeof(link->rtable));
+  memset(&link->neighbour, 0, sizeof(NEIGHBOUR));
   
+  fec_init();
+}
+
+
+//FEC is on while the other end can decode it, and either end asked for it, so both ends come to the same answer.
+//Called again with every HELLO, since that is when we learn what the other end wants
+void link_set_fec(LINK *link, uint8_t enable)
+{
+  uint8_t on = (link->fec_peer & HELLO_FEC_CAPABLE) && (enable || (link->fec_peer & HELLO_FEC_WANTED));
 
+  if (on != link->fec_on)
+    printf("FEC %s\n", on ? "on" : "off");
+
+  link->fec_wanted = enable;
+  link->fec_on = on;
 }
 
 
@@ -122,12 +141,19 @@ uint8_t create_send_frame(uint8_t src, uint8_t dst, uint8_t size, uchar *payload
 
 uint8_t create_send_cframe(uint8_t src, uint8_t dst, uint8_t size, uchar *payload, LINK *link)
 {
+	link->ctrl_bytes_sent += FRAME_HEADER_SIZE + size + 2;
 	return add_to_send_queue(frame_to_raw(create_cframe(src, dst, size, payload)), link);
 }
 
+uint8_t create_send_gframe(uint8_t src, uint8_t group, uint8_t size, uchar *payload, LINK *link)
+{
+	return add_to_send_queue(frame_to_raw(create_gframe(src, group, size, payload)), link);
+}
+
 uint8_t transmit_next(LINK *link)
 {
   uint8_t i, j;
+  uchar *wire;
 
   //Check if we have anything to transmit
   if (link->squeue_pending == 0)
@@ -144,8 +170,16 @@ uint8_t transmit_next(LINK *link)
   }
 
   
-  //Transmit the packet out onto the link
-  link->port->write(link->send_queue[i].buf, link->send_queue[i].size);
+  //Transmit the packet out onto the link, as FEC blocks if it was negotiated. Queued frames stay plain, since a
+  //buffer may be shared with links that do not use it
+  wire = link->fec_on ? (uchar*)malloc(FEC_WIRE_SIZE(link->send_queue[i].buf[3])) : NULL;
+  if (wire != NULL)
+  {
+    link->port->write(wire, fec_encode(link->send_queue[i].buf, link->send_queue[i].size, wire));
+    free(wire);
+  }
+  else
+    link->port->write(link->send_queue[i].buf, link->send_queue[i].size);
   
   /*
   printf("\nTransmitting:\n");
@@ -158,7 +192,7 @@ uint8_t transmit_next(LINK *link)
   link->squeue_lastsent = i;
   link->squeue_pending--;
   link->send_queue[i].size = 0;
-  free(link->send_queue[i].buf);
+  raw_release(link->send_queue[i]);
 
   return i;
 }
@@ -12,7 +12,8 @@
 Initialization
 *******************************/
 
-void link_init(HardwareSerial *port, uint8_t my_id, LINK_TYPE link_type, LINK *link);
+void link_init(Stream *port, uint8_t my_id, LINK_TYPE link_type, LINK *link);
+void link_set_fec(LINK *link, uint8_t enable);
 
 
 /*******************************
@@ -30,6 +31,7 @@ Sending Frames
 uint8_t send_frame(FRAME frame, LINK *link);
 uint8_t create_send_frame(uint8_t src, uint8_t dst, uint8_t size, uchar *payload, LINK *link);
 uint8_t create_send_cframe(uint8_t src, uint8_t dst, uint8_t size, uchar *payload, LINK *link);
+uint8_t create_send_gframe(uint8_t src, uint8_t group, uint8_t size, uchar *payload, LINK *link);
 uint8_t transmit_next(LINK *link);
 
 
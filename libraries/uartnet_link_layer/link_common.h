@@ -4,6 +4,7 @@
 #define _UARTNET_LINK_COMMONH_
 
 #include "frame.h"
+#include "fec.h"
 
 #include "Arduino.h"
 #include <HardwareSerial.h>
@@ -15,16 +16,25 @@ Routing Table Nodes
 
 #define NODE_LENGTH		2		//size of id + hops
 
+//Each routing table entry is one byte: hop count in the low nibble, missed ticks in the high nibble
+#define RT_HOPS_MASK		0x0F
+#define RT_TICK				0x10
+#define RT_MAX_TICKS		0x0F
+
+#define RT_HOPS(link, id)	((link)->rtable[id] & RT_HOPS_MASK)
+#define RT_TICKS(link, id)	((link)->rtable[id] >> 4)
+
+
+//A UART link is point-to-point, so ping timestamps and RTT only ever exist for the one neighbour at the other end.
+//Timestamps are the low 16 bits of millis(), so only differences under ~65 seconds are meaningful.
 typedef struct{
 	
-	uint8_t hops;
-	uint16_t rtt;						//RTT from the last PING/PONG
-	
-	uint8_t ticks;						//Ticks elapsed since last heard from this node
-	unsigned long last_ping_recvd;		//When was the last time a ping was received
-	unsigned long last_ping_sent;		//"Timestamp" of when a ping is sent to this node. Used to calculate RTT when this node replies to the ping
+	uint16_t srtt;						//Smoothed RTT in 1/8 ms (EWMA, gain 1/8). 0 until the first sample
+	uint16_t rttvar;					//Smoothed RTT deviation (jitter) in 1/4 ms (EWMA, gain 1/4)
+	uint16_t last_ping_recvd;			//When was the last time a ping was received
+	uint16_t peer_stamp;				//Timestamp carried in the neighbour's last HELLO, echoed back in ours to measure RTT
 
-}NODE;
+}NEIGHBOUR;
 
 
 /*******************************
@@ -32,7 +42,7 @@ Link descriptor
 *******************************/
 
 //#define RECV_BUFFER_SIZE  	2*(MAX_PAYLOAD_SIZE + 16)     //add extra bytes for headers and other
-#define RECV_BUFFER_SIZE  	MAX_PAYLOAD_SIZE 
+#define RECV_BUFFER_SIZE  	(FEC_WIRE_MAX + 1)		//A full-size frame as FEC sends it, its longest form on the line. +1 for the overflow check
 #define FLUSH_THRESHOLD   	RECV_BUFFER_SIZE * 0.5
 
 #define RECV_QUEUE_SIZE		8
@@ -41,13 +51,49 @@ Link descriptor
 #define RTABLE_LENGTH		MAX_ADDRESS			//TODO: exclude "0" and broadcast address
 
 
+//Bitmap of live routing entries, one bit per address. Wider address spaces switch to 32-bit words at compile time
+#if ADDRESS_WIDTH <= 4
+typedef uint16_t RT_WORD;
+#define RT_WORD_BITS		16
+#else
+typedef uint32_t RT_WORD;
+#define RT_WORD_BITS		32
+#endif
+
+#define RT_BITMAP_WORDS		((RTABLE_LENGTH + RT_WORD_BITS - 1) / RT_WORD_BITS)
+
+//Multicast group membership, one bit per group. A word of the routing bitmap always has room for every group
+typedef RT_WORD GROUP_MASK;
+#define GROUP_BIT(group)	((GROUP_MASK)1 << (group))
+
+
 typedef enum {UNKNOWN = 0, GATEWAY, ENDPOINT} LINK_TYPE;
 
 
+/*******************************
+Frame callbacks
+*******************************/
+
+#define MAX_HANDLERS_PER_EVENT		2		//Subscribers allowed for each event on a link
+
+//Events that user handlers can be registered against. Used directly as an index into the link's handler table
+typedef enum {MESSAGE_EVENT = 0, HELLO_EVENT, JOIN_EVENT, LEAVE_EVENT, RTBLE_EVENT, REQRT_EVENT, TOTAL_FRAME_EVENTS} FRAME_EVENT;
+
+struct LINK;
+typedef void (*FRAME_HANDLER)(const FRAME &frame, struct LINK *link, void *ctx);
+
 typedef struct{
+	
+	FRAME_HANDLER handler;
+	void *ctx;							//User context passed back to the handler untouched
+	
+}FRAME_CALLBACK;
+
+
+typedef struct LINK{
 
   //Physical Link Configurations
-  HardwareSerial *port;
+  Stream *port;
   LINK_TYPE link_type;					//What is this link configured as?
   LINK_TYPE end_link_type;				//What is the other end of this link configured as?
   uint8_t id;							//My GUID
@@ -71,11 +117,50 @@ typedef struct{
   uint8_t squeue_lastsent;
   
   //Routing Table
-  NODE rtable[RTABLE_LENGTH];
-  uint8_t rtable_entries;
+  uint8_t rtable[RTABLE_LENGTH];		//Packed hops/ticks, see RT_HOPS() and RT_TICKS()
+  RT_WORD rtable_live[RT_BITMAP_WORDS];	//Bit set for every entry with hops > 0. Only update_rtable_entry() touches it
+  uint8_t rt_version;					//Routing version last known to be in sync across this link. 0 = never synced
+  uint8_t rt_sent_version;				//Routing version last sent to the other end (switch only)
+  GROUP_MASK groups;					//Multicast groups subscribed behind this link (switch only)
+  
+  //Forward error correction, see fec.h. Frames received with FEC are always decoded; whether we send with it is
+  //negotiated in the HELLOs, see link_set_fec()
+  uint8_t fec_wanted;					//Asked for on this end
+  uint8_t fec_peer;						//HELLO_FEC_* flags the other end sent last
+  uint8_t fec_on;						//Frames go out with FEC
+  
+  //Statistics
+  unsigned long ctrl_bytes_sent;		//Bytes of control frames queued on this link
+  unsigned long mcast_bytes_pruned;		//Multicast bytes flooding would have sent here, but nobody subscribed
+  unsigned long fec_corrected;			//Bytes FEC put right
+  unsigned long fec_failed;				//FEC frames with a block beyond repair, dropped
+  
+  NEIGHBOUR neighbour;
+  
+  //User handlers for received frames, indexed by FRAME_EVENT
+  FRAME_CALLBACK handlers[TOTAL_FRAME_EVENTS][MAX_HANDLERS_PER_EVENT];
+  uint8_t handler_count[TOTAL_FRAME_EVENTS];
   
 }LINK;
 
+//The routing table stays packed whatever the address width. Checked here rather than counted by hand, since the rest
+//of LINK (the receive buffer above all) changes size with the frame and FEC settings
+static_assert(sizeof(((LINK*)0)->rtable) == RTABLE_LENGTH, "Routing table entries must stay one byte each");
+static_assert(sizeof(NEIGHBOUR) == 4 * sizeof(uint16_t), "NEIGHBOUR must stay four 16-bit fields");
+
+
+//Missed tick bookkeeping on a packed routing entry
+inline void rt_reset_ticks(LINK *link, uint8_t id)
+{
+	link->rtable[id] &= RT_HOPS_MASK;
+}
+
+inline void rt_add_tick(LINK *link, uint8_t id)
+{
+	if(RT_TICKS(link, id) < RT_MAX_TICKS)
+		link->rtable[id] += RT_TICK;
+}
+
 
 
 
@@ -5,6 +5,31 @@
 Frame Synchronization / Receiving Raw bytes
 ***************************/
 
+//Could the bytes at buf be a FEC frame whose preamble the line corrupted? Its header block still knows. Only decoded
+//where one of the two preamble bytes survived, so a scan through noise costs little
+uint8_t fec_resync(uchar *buf, int bytes, LINK *link)
+{
+  uchar header[FEC_HEADER_WIRE];
+  int fixed;
+
+  if (bytes < FEC_HEADER_WIRE)
+    return 0;
+
+  if (buf[1] != (uchar)(FEC_PREAMBLE(MFRAME_PREAMBLE) >> 8) && buf[0] != (uchar)FEC_PREAMBLE(MFRAME_PREAMBLE) &&
+      buf[0] != (uchar)FEC_PREAMBLE(CFRAME_PREAMBLE) && buf[0] != (uchar)FEC_PREAMBLE(GFRAME_PREAMBLE))
+    return 0;
+
+  memcpy(header, buf, FEC_HEADER_WIRE);
+  fixed = fec_decode_block(header, FRAME_HEADER_SIZE);
+  if (fixed <= 0 || !IS_FEC_PREAMBLE(*((uint16_t*)&header[0])))
+    return 0;
+
+  memcpy(buf, header, FEC_HEADER_WIRE);
+  link->fec_corrected += fixed;
+  return 1;
+}
+
+
 void proc_buf(uchar *rawbuf, size_t chunk_size, LINK *link)
 {
   int i;
@@ -26,10 +51,11 @@ void proc_buf(uchar *rawbuf, size_t chunk_size, LINK *link)
     {
       preamble = *((uint16_t*) &link->recvbuf[i]);
       
-      if (preamble == MFRAME_PREAMBLE || preamble == CFRAME_PREAMBLE)
+      if (preamble == MFRAME_PREAMBLE || preamble == CFRAME_PREAMBLE || preamble == GFRAME_PREAMBLE ||
+          IS_FEC_PREAMBLE(preamble) || fec_resync(&link->recvbuf[i], link->rbuf_writeidx - i, link))
       {
         //printf("Found a preamble: %X\n", preamble);      
-        memcpy(&link->recvbuf[0], &link->recvbuf[i], (RECV_BUFFER_SIZE - i));
+        memmove(&link->recvbuf[0], &link->recvbuf[i], link->rbuf_writeidx - i);   //The two overlap
         link->rbuf_writeidx -= i;
         link->rbuf_valid = 1;
         break;
@@ -48,11 +74,46 @@ void proc_buf(uchar *rawbuf, size_t chunk_size, LINK *link)
 
 
 
+//The header block of a FEC frame is corrected as soon as it is in, since the frame's size comes from it. A header
+//beyond repair leaves nothing to go by, so the buffer goes back to looking for a preamble
+size_t check_complete_fec_frame(LINK *link)
+{
+  int fixed;
+
+  if (link->rbuf_expectedsize == 0)
+  {
+    if (link->rbuf_writeidx < FEC_HEADER_WIRE)
+      return 0;
+
+    fixed = fec_decode_block(link->recvbuf, FRAME_HEADER_SIZE);
+    if (fixed < 0 || !IS_FEC_PREAMBLE(*((uint16_t*)&link->recvbuf[0])))
+    {
+      printf("FEC header beyond repair. Dropping...\n");
+      link->fec_failed++;
+      link->recvbuf[0] = 0;
+      link->rbuf_valid = 0;
+      return 0;
+    }
+
+    link->fec_corrected += fixed;
+    link->rbuf_expectedsize = FEC_WIRE_SIZE(link->recvbuf[3]);
+  }
+
+  if (link->rbuf_writeidx >= link->rbuf_expectedsize)
+    return link->rbuf_expectedsize;
+  else
+    return 0;
+}
+
+
 size_t check_complete_frame(LINK *link)
 {
   uint16_t preamble = *((uint16_t*)&link->recvbuf[0]);
 
-  if (preamble != MFRAME_PREAMBLE && preamble != CFRAME_PREAMBLE)
+  if (IS_FEC_PREAMBLE(preamble))
+    return check_complete_fec_frame(link);
+
+  if (preamble != MFRAME_PREAMBLE && preamble != CFRAME_PREAMBLE && preamble != GFRAME_PREAMBLE)
     return 0;
 
   //Set the expected payload size if full header has received
@@ -79,6 +140,10 @@ size_t check_new_bytes(LINK *link)
   if (bytes <= 0)
     return 0;
 
+  //Only take what fits. Ports with deep buffers (e.g. on a host) keep the rest until the next call
+  if (bytes > RECV_BUFFER_SIZE - 1 - link->rbuf_writeidx && link->rbuf_writeidx < RECV_BUFFER_SIZE - 1)
+    bytes = RECV_BUFFER_SIZE - 1 - link->rbuf_writeidx;
+
   bytes = link->port->readBytes(tempbuf, bytes);
   
   //Make sure we're not overflowing the buffer
@@ -107,28 +172,51 @@ size_t check_new_bytes(LINK *link)
 RAW_FRAME extract_frame_from_rbuf(LINK *link)
 {
   RAW_FRAME raw_frame;
+  size_t wire_size;
+  int fixed;
+
   raw_frame.size = check_complete_frame(link);
+  raw_frame.refs = NULL;
 
   //If the buffer doesn't have any fully received packets, return size 0
   if (raw_frame.size <= 0)
     return raw_frame;
 
+  wire_size = raw_frame.size;
+
   /*
   printf("Complete packet received! %u bytes!\n", raw_frame.size);
   print_bytes(&link->recvbuf[0], raw_frame.size);
   printf("\n");
   */
 
-  //Allocate a new buffer for the raw packet for returning
-  raw_frame.buf = malloc(raw_frame.size);
-  memcpy(raw_frame.buf, link->recvbuf, raw_frame.size);
+  //Allocate a new buffer for the raw packet for returning. FEC frames are corrected on the way
+  if (IS_FEC_PREAMBLE(*((uint16_t*)&link->recvbuf[0])))
+  {
+    raw_frame.size = FRAME_HEADER_SIZE + link->recvbuf[3] + 2;
+    raw_frame.buf = malloc(raw_frame.size + RAW_SPARE_SIZE);
+
+    fixed = fec_decode(link->recvbuf, raw_frame.buf);
+    if (fixed < 0)
+    {
+      raw_frame.buf[raw_frame.size - 1] = ABORT;
+      link->fec_failed++;
+    }
+    else
+      link->fec_corrected += fixed;
+  }
+  else
+  {
+    raw_frame.buf = malloc(raw_frame.size + RAW_SPARE_SIZE);
+    memcpy(raw_frame.buf, link->recvbuf, raw_frame.size);
+  }
 
   link->rbuf_valid = 0;
   link->rbuf_expectedsize = 0;
 
-  //Move write pointer to the end of the packet
-  link->rbuf_writeidx -= raw_frame.size;
-  memcpy(&link->recvbuf[0], &link->recvbuf[raw_frame.size], (RECV_BUFFER_SIZE - raw_frame.size));
+  //Move write pointer to the end of the packet. Only the bytes of the next one need moving, and the two may overlap
+  link->rbuf_writeidx -= wire_size;
+  memmove(&link->recvbuf[0], &link->recvbuf[wire_size], link->rbuf_writeidx);
 
   return raw_frame;
 }
@@ -140,6 +228,14 @@ uint8_t parse_raw_and_store(RAW_FRAME raw, LINK *link)
 	uint8_t i, j;
 	FRAME frame;
 	
+	//A switch upstream gave up on this frame halfway through
+	if (RAW_ABORTED(raw))
+	{
+		printf("Aborted frame received. Dropping...\n");
+		free(raw.buf);
+		return 0;
+	}
+	
 	//Parse the RAW_FRAME into a structured FRAME
 	frame = raw_to_frame(raw);
 	free(raw.buf);
@@ -191,7 +287,7 @@ uint8_t add_to_send_queue(RAW_FRAME raw, LINK *link)
   if (link->squeue_pending == SEND_QUEUE_SIZE )
   {
     printf("Send Queue is full! Dropping request...\n");
-    free(raw.buf);
+    raw_release(raw);
     return 0;
   }
 
@@ -210,3 +306,25 @@ uint8_t add_to_send_queue(RAW_FRAME raw, LINK *link)
 
   return 1;
 }
+
+
+//Drop every queued frame addressed to dst, e.g. once dst is known to be dead. Returns how many were dropped.
+//GFRAMEs carry a group in the dst field, so a multicast to the same-numbered group is kept
+uint8_t purge_send_queue(uint8_t dst, LINK *link)
+{
+  uint8_t i, purged = 0;
+
+  for (i = 0; i < SEND_QUEUE_SIZE; i++)
+  {
+    if (link->send_queue[i].size == 0 || ((uint8_t)link->send_queue[i].buf[2] >> 4) != dst ||
+        *((uint16_t*)&link->send_queue[i].buf[0]) == GFRAME_PREAMBLE)
+      continue;
+
+    raw_release(link->send_queue[i]);
+    link->send_queue[i].size = 0;
+    link->squeue_pending--;
+    purged++;
+  }
+
+  return purged;
+}
@@ -14,5 +14,6 @@ uint8_t parse_raw_and_store(RAW_FRAME raw, LINK *link);
 
 //Sending to link
 uint8_t add_to_send_queue(RAW_FRAME raw, LINK *link);
+uint8_t purge_send_queue(uint8_t dst, LINK *link);
 
 #endif
\ No newline at end of file
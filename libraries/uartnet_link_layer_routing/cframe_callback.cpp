@@ -1,79 +1,50 @@
 #include "cframe_callback.h"
 
 
-//Set the pointers
-
-void set_message_handler(void (*handler_ptr)(FRAME))
-{
-	message_handler = handler_ptr;
-}
-
-void set_hello_handler(void (*handler_ptr)(FRAME))
-{
-	hello_handler = handler_ptr;
-}
-
-void set_join_handler(void (*handler_ptr)(FRAME))
-{
-	join_handler = handler_ptr;
-}
-
-void set_leave_handler(void (*handler_ptr)(FRAME))
-{
-	leave_handler = handler_ptr;
-}
-
-void set_rtble_handler(void (*handler_ptr)(FRAME))
-{
-	rtble_handler = handler_ptr;
-}
-
-void set_reqrt_handler(void (*handler_ptr)(FRAME))
-{
-	reqrt_handler = handler_ptr;
-}
-
-
-//Default handlers
-
-void message_handler_default(FRAME frame)
-{
+uint8_t add_frame_handler(LINK *link, FRAME_EVENT event, FRAME_HANDLER handler, void *ctx)
+{
+	uint8_t count;
+	
+	if(event >= TOTAL_FRAME_EVENTS || handler == NULL)
+		return 0;
+	
+	count = link->handler_count[event];
+	
+	//Make sure there is still room for another subscriber
+	if(count >= MAX_HANDLERS_PER_EVENT)
+	{
+		printf("ERROR: Too many handlers for event %d\n", event);
+		return 0;
+	}
+	
+	link->handlers[event][count].handler = handler;
+	link->handlers[event][count].ctx = ctx;
+	link->handler_count[event]++;
+	
+	return 1;
+}
+
+
+uint8_t remove_frame_handler(LINK *link, FRAME_EVENT event, FRAME_HANDLER handler, void *ctx)
+{
+	uint8_t i;
+	FRAME_CALLBACK *cb;
+	
+	if(event >= TOTAL_FRAME_EVENTS)
+		return 0;
+	
+	cb = link->handlers[event];
+	
+	for(i = 0; i < link->handler_count[event]; i++)
+	{
+		if(cb[i].handler != handler || cb[i].ctx != ctx)
+			continue;
+		
+		//Shift the remaining subscribers down so dispatch order is kept
+		memmove(&cb[i], &cb[i + 1], (link->handler_count[event] - i - 1) * sizeof(FRAME_CALLBACK));
+		link->handler_count[event]--;
+		return 1;
+	}
+	
 	return 0;
 }
-
-void hello_handler_default(FRAME frame)
-{
-	return 0;
-}
-
-void join_handler_default(FRAME frame)
-{
-	return 0;
-}
-
-void leave_handler_default(FRAME frame)
-{
-	return 0;
-}
-
-void rtble_handler_default(FRAME frame)
-{
-	return 0;
-}
-
-void reqrt_handler_default(FRAME frame)
-{
-	return 0;
-}
-
-
-//Initialize all handlers with default handlers
-
-void (*message_handler)(FRAME) 					= message_handler_default; 
-void (*hello_handler)(FRAME) 					= hello_handler_default;
-void (*join_handler)(FRAME)					= join_handler_default;
-void (*leave_handler)(FRAME)			= leave_handler_default;
-void (*rtble_handler)(FRAME)	= rtble_handler_default;
-void (*reqrt_handler)(FRAME)					= reqrt_handler_default;
-
-
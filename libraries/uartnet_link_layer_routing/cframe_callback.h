@@ -1,29 +1,23 @@
-#ifndef _UARTNET_LINK_CFRAME_CALLBACK_H_
-#define _UARTNET_LINK_CALLBACK_H_
+#ifndef _UARTNET_LINK_CFRAME_CALLBACKH_
+#define _UARTNET_LINK_CFRAME_CALLBACKH_
 
 #include <link.h>
 
 
+//Register/unregister a handler for an event on a single link. ctx is handed back to the handler on every call
+uint8_t add_frame_handler(LINK *link, FRAME_EVENT event, FRAME_HANDLER handler, void *ctx);
+uint8_t remove_frame_handler(LINK *link, FRAME_EVENT event, FRAME_HANDLER handler, void *ctx);
 
-//Function Pointers for control message handlers
-extern void (*message_handler)	(FRAME); 
-extern void (*hello_handler)	(FRAME);
-extern void (*join_handler)		(FRAME);
-extern void (*leave_handler)	(FRAME);
-extern void (*rtble_handler)	(FRAME);
-extern void (*reqrt_handler)	(FRAME);
 
+//Call every handler subscribed to the event on this link
+inline void dispatch_frame_event(FRAME_EVENT event, const FRAME &frame, LINK *link)
+{
+	uint8_t i;
+	FRAME_CALLBACK *cb = link->handlers[event];
+	
+	for(i = 0; i < link->handler_count[event]; i++)
+		cb[i].handler(frame, link, cb[i].ctx);
+}
 
-//Function to change the default handlers with a user defined handler
-void set_message_handler(void (*handler_ptr)(FRAME));
-void set_hello_handler(void (*handler_ptr)(FRAME));
-void set_join_handler(void (*handler_ptr)(FRAME));
-void set_leave_handler(void (*handler_ptr)(FRAME));
-void set_rtble_handler(void (*handler_ptr)(FRAME));
-void set_reqrt_handler(void (*handler_ptr)(FRAME));
 
-
-
-
-
-#endif
\ No newline at end of file
+#endif
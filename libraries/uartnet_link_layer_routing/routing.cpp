@@ -1,5 +1,13 @@
 #include "routing.h"
 
+uint8_t hello_nonce = 0;
+
+//Bit twiddling on a single RT_WORD. The long variants cover both word widths
+#define RT_BIT(id)				((RT_WORD)1 << ((id) % RT_WORD_BITS))
+#define RT_LOWEST(bits)			((uint8_t)__builtin_ctzl((unsigned long)(bits)))
+#define RT_HIGHEST(bits)		((uint8_t)(8 * sizeof(unsigned long) - 1 - __builtin_clzl((unsigned long)(bits))))
+
+
 uint8_t update_rtable_entry(uint8_t id, uint8_t hops, LINK *link)
 {
 	//Make sure the source id is valid
@@ -9,72 +17,84 @@ uint8_t update_rtable_entry(uint8_t id, uint8_t hops, LINK *link)
 		return 0;
 	}
 
-	//Increment the routing table entry count
-	if(link->rtable[id].hops > 0)
+	//Anything that does not fit the packed entry is unreachable
+	if(hops >= RT_INFINITY)
+		hops = 0;
+	
+	if(RT_HOPS(link, id) > 0 && hops > 0)
 		printf("Overwriting existing route entry for node %d\n", id);
+	
+	//Update the entry (which also clears its ticks), and its bit in the live bitmap
+	link->rtable[id] = hops;
+	
+	if(hops > 0)
+		link->rtable_live[id / RT_WORD_BITS] |= RT_BIT(id);
 	else
-		link->rtable_entries++;
+		link->rtable_live[id / RT_WORD_BITS] &= ~RT_BIT(id);
 	
-	//Update the entry
-	link->rtable[id].hops = hops;
-	link->rtable[id].ticks = 0;
-	printf("Updated Routing entry: %d, %d hops\n", id, link->rtable[id].hops);
+	printf("Updated Routing entry: %d, %d hops\n", id, hops);
 	
 	return 1;
 }
 
 
+//Number of live entries in the routing table
+uint8_t rtable_count(LINK *link)
+{
+	uint8_t w, count = 0;
+	
+	for(w = 0; w < RT_BITMAP_WORDS; w++)
+		count += __builtin_popcountl((unsigned long)link->rtable_live[w]);
+	
+	return count;
+}
+
+
+//Lowest live ID that is >= id. Returns 0 if there is none
 uint8_t find_successor(uint8_t id, LINK *link)
 {
-	int i;
+	uint8_t w;
+	RT_WORD bits;
 	
-	if(link->rtable_entries == 0)
+	if(id >= RTABLE_LENGTH)
 		return 0;
 	
-	if(id == MAX_ADDRESS)
-		return 0;
+	//Mask off everything below id in its word, then move on to the next non-empty word
+	w = id / RT_WORD_BITS;
+	bits = link->rtable_live[w] & (RT_WORD)~(RT_BIT(id) - 1);
 	
-	//Find the lowest valid ID starting from the end of the rtable
-	for(i = id; i < RTABLE_LENGTH; i++)
+	while(bits == 0)
 	{
-		if(link->rtable[i].hops > 0)
-		{
-			printf("Sucessor ID: %u\n", i);
-			return i;
-		}
+		if(++w >= RT_BITMAP_WORDS)
+			return 0;
+		bits = link->rtable_live[w];
 	}
 	
-	//Didn't find any nodes in this range?
-	if(i == MAX_ADDRESS)
-	{
-		printf("Successor ID: 0 (cannot find)\n");
-		return 0;
-	}
+	return w * RT_WORD_BITS + RT_LOWEST(bits);
 }
 
 
+//Highest live ID that is <= id. Returns 0 if there is none
 uint8_t find_predecessor(uint8_t id, LINK *link)
 {
-	int i;
-	
-	if(link->rtable_entries <= 0)
-		return 0;
+	int8_t w;
+	RT_WORD bits;
 	
 	if(id >= MAX_ADDRESS)
 		id = MAX_ADDRESS - 1;
 	
-	//Find the highest valid ID starting from the end of the rtable
-	for(i = id; i > 0; i--)
+	//Mask off everything above id in its word, then move back to the previous non-empty word
+	w = id / RT_WORD_BITS;
+	bits = link->rtable_live[w] & (RT_WORD)(RT_BIT(id) | (RT_BIT(id) - 1));
+	
+	while(bits == 0)
 	{
-		if(link->rtable[i].hops > 0)
-		{
-			printf("HIGHEST ID: %u\n", i);
-			break;
-		}
+		if(--w < 0)
+			return 0;
+		bits = link->rtable_live[w];
 	}
 	
-	//Will return 0 if no nodes are found in the range
-	return i;
+	return w * RT_WORD_BITS + RT_HIGHEST(bits);
 }
 
 
@@ -86,17 +106,20 @@ SENDING
 
 uint8_t send_hello_msg(uint8_t my_id, uint8_t dst_id, LINK *link)
 {	
-	uint8_t pl_size = LINK_MSG_SIZE + 1;		//Buffer for preamble + type 
-	uchar msg[pl_size];		
+	uchar msg[HELLO_SIZE];		//Buffer for preamble + type + nonce + stamp + echo + FEC flags
+	uint16_t now = millis();
+	uint16_t echo = 0;
 
 	//Copy the preamble string to the payload
 	strncpy(msg, PROBE_PREAMBLE, LINK_MSG_SIZE);
 	
-	//Append my link type after the preamble, and sent time
+	//Append my link type after the preamble. Switches also tag the HELLO with their nonce
+	msg[LINK_MSG_SIZE + 1] = 0;
 	switch(link->link_type)
 	{
 		case GATEWAY:
 			msg[LINK_MSG_SIZE] = SWITCH_LINK_SYMBOL;
+			msg[LINK_MSG_SIZE + 1] = hello_nonce;
 			break;
 			
 		case ENDPOINT:
@@ -107,27 +130,67 @@ uint8_t send_hello_msg(uint8_t my_id, uint8_t dst_id, LINK *link)
 		default:
 			msg[LINK_MSG_SIZE] = 0;
 	}
+	
+	//Echo the neighbour's last stamp, advanced by how long we held on to it. The neighbour's RTT is then simply
+	//its receive time minus the echo, no matter whether this HELLO is an immediate reply or a later heartbeat
+	if(link->neighbour.peer_stamp != 0)
+		echo = link->neighbour.peer_stamp + (uint16_t)(now - link->neighbour.last_ping_recvd);
+	
+	memcpy(&msg[LINK_MSG_SIZE + 2], &now, 2);
+	memcpy(&msg[LINK_MSG_SIZE + 4], &echo, 2);
+	msg[LINK_MSG_SIZE + 6] = HELLO_FEC_CAPABLE | (link->fec_wanted ? HELLO_FEC_WANTED : 0);
 
 	
 	/*
 	printf("Probe msg:");
-	print_bytes(msg, LINK_MSG_SIZE + 3);
+	print_bytes(msg, HELLO_SIZE);
 	printf("\n");
 	*/
 	
 	//Create and send out an "HELLO" message
 	printf("Sending HELLO\n");
-	create_send_cframe(my_id, 0, pl_size, msg, link);
+	create_send_cframe(my_id, 0, HELLO_SIZE, msg, link);
 
 	return 0;
 }
 
 uint8_t send_hello(uint8_t my_id, uint8_t dst_id, LINK *link)
 {
+	return send_hello_msg(my_id, 0, link);
+}
+
+
+//Fold a new RTT sample (ms) into the link's smoothed RTT and jitter, the same way TCP does
+void update_rtt(LINK *link, uint16_t sample)
+{
+	int16_t delta;
+	
+	if(link->neighbour.srtt == 0)
+	{
+		link->neighbour.srtt = sample << 3;
+		link->neighbour.rttvar = sample << 1;
+		return;
+	}
+	
+	delta = sample - LINK_SRTT(link);
+	link->neighbour.srtt += delta;
+	
+	if(delta < 0)
+		delta = -delta;
+	link->neighbour.rttvar += delta - LINK_RTTVAR(link);
+}
+
+
+//Additive latency metric of a link: one-way delay, padded by its jitter
+uint16_t link_cost(LINK *link)
+{
+	uint16_t cost;
 	
-	link->rtable[dst_id].last_ping_sent = millis();
+	if(link->neighbour.srtt == 0)
+		return RT_DEFAULT_COST;
 	
-	return send_hello_msg(my_id, 0, link);
+	cost = (LINK_SRTT(link) + LINK_RTTVAR(link)) / 2;
+	return cost ? cost : 1;
 }
 
 
@@ -188,34 +251,33 @@ uint8_t send_leave_msg(uint8_t id, uint8_t reason, LINK *link)
 uint8_t send_rtble_msg(uint8_t dst, LINK *link)
 {
 	uint8_t i, j, writeidx;
+	uint8_t entries = rtable_count(link);
 	
-	uint8_t pl_size = LINK_MSG_SIZE + 1 + link->rtable_entries * NODE_LENGTH;
-	uchar msg[pl_size];		//Buffer for preamble + entries
+	uint8_t pl_size = RTBLE_HEADER_SIZE + entries * NODE_LENGTH;
+	uchar msg[pl_size];		//Buffer for preamble + entries + version
 	
 	//Copy the preamble string to the payload
 	strncpy(msg, ROUTING_PREAMBLE, LINK_MSG_SIZE);
 	
 	//Append the number of routing entries that follows
-	msg[LINK_MSG_SIZE] = link->rtable_entries;
+	msg[LINK_MSG_SIZE] = entries;
+	msg[LINK_MSG_SIZE + 1] = link->rt_version;
 	
-	//Append each of the node information to the payload
-	for(i=0, j=0; i<RTABLE_LENGTH; i++)
+	//Append each of the node information to the payload, walking only the live entries
+	for(i = find_successor(1, link), j = 0; i != 0; i = find_successor(i + 1, link))
 	{
-		if(link->rtable[i].hops > 0)
-		{
-			//Increment the write index for the payload
-			writeidx = LINK_MSG_SIZE + 1 + NODE_LENGTH*(j++);
-			
-			//Write the ID
-			msg[writeidx] = (uint8_t)i;
-			
-			//Write and increment the hops
-			msg[writeidx + 1] = (uint8_t)(link->rtable[i].hops + 1);
-		}
+		//Increment the write index for the payload
+		writeidx = RTBLE_HEADER_SIZE + NODE_LENGTH*(j++);
+		
+		//Write the ID
+		msg[writeidx] = (uint8_t)i;
+		
+		//Write and increment the hops
+		msg[writeidx + 1] = (uint8_t)(RT_HOPS(link, i) + 1);
 	}
 	
 	/*
-	printf("Written %d entries. Should be %d\n", j, link->rtable_entries);
+	printf("Written %d entries. Should be %d\n", j, entries);
 	print_bytes(msg, pl_size);
 	printf("\n");
 	*/
@@ -232,7 +294,38 @@ uint8_t send_rtble_msg(uint8_t dst, LINK *link)
 uint8_t send_reqrt_msg(uint8_t dst, LINK *link)
 {
 	printf("Sending REQRT to %d\n", dst);
-	create_send_cframe(link->id, dst, LINK_MSG_SIZE, ROUTING_PREAMBLE, link);
+	create_send_cframe(link->id, dst, LINK_MSG_SIZE, REQRT_PREAMBLE, link);
+	
+	return 0;
+}
+
+
+//Acknowledge that the routing table has been brought up to the given version
+uint8_t send_rtack_msg(uint8_t version, LINK *link)
+{
+	uint8_t pl_size = LINK_MSG_SIZE + 1;		//Buffer for preamble + version
+	uchar msg[pl_size];
+	
+	strncpy(msg, RTACK_PREAMBLE, LINK_MSG_SIZE);
+	msg[LINK_MSG_SIZE] = version;
+	
+	create_send_cframe(link->id, 0, pl_size, msg, link);
+	
+	return 0;
+}
+
+
+//Subscribe to (join = 1) or unsubscribe from a multicast group. Only the switch at the other end keeps track
+uint8_t send_group_msg(uint8_t my_id, uint8_t group, uint8_t join, LINK *link)
+{
+	uint8_t pl_size = LINK_MSG_SIZE + 1;		//Buffer for preamble + group
+	uchar msg[pl_size];
+	
+	strncpy(msg, join ? GJOIN_PREAMBLE : GLEAVE_PREAMBLE, LINK_MSG_SIZE);
+	msg[LINK_MSG_SIZE] = group;
+	
+	printf("Sending %s for group %u\n", join ? "GJOIN" : "GLEAV", group);
+	create_send_cframe(my_id, 0, pl_size, msg, link);
 	
 	return 0;
 }
@@ -247,18 +340,24 @@ uint8_t parse_hello_msg(FRAME frame, LINK *link)
 	uint8_t end_id = frame.src;
 	uchar end_type = frame.payload[LINK_MSG_SIZE];
 	
-	unsigned long recv_time = millis();
-	int rtt;
-	uint16_t rtable_idx = end_id;
+	uint16_t recv_time = millis();
+	uint16_t echo;
 	uint8_t reply = 0;				//0 = nothing, 1 = reply, 2 = resend 
 	
 	printf("Received PROBE from %d, type: %c ", end_id, end_type);
 	
+	//Our own HELLO came back. The link is looped, so never reply or we would be talking to ourselves forever
+	if(link->link_type == GATEWAY && end_type == SWITCH_LINK_SYMBOL && frame.size > LINK_MSG_SIZE + 1 && frame.payload[LINK_MSG_SIZE + 1] == hello_nonce)
+	{
+		printf("Loopback detected! Ignoring link\n");
+		link->end_link_type = UNKNOWN;
+		return 0;
+	}
+	
 	//First time hearing from the other end of the link
 	if(link->end_link_type == UNKNOWN)
 	{
 		reply = 2;
-		rtable_idx = 0;
 		
 		//Record the link type at the other end
 		switch(end_type)
@@ -284,13 +383,35 @@ uint8_t parse_hello_msg(FRAME frame, LINK *link)
 	}
 	
 	//Reset the sender's missed tick count
-	link->rtable[rtable_idx].
+	if(end_id > 0 && end_id < MAX_ADDRESS)
+		rt_reset_ticks(link, end_id);
 
-	rtt = recv_time - link->rtable[rtable_idx].last_ping_sent;
-	printf("rtt: %d ms\n", rtt);
+	//Our own stamp came back. Older peers without stamps leave the RTT alone
+	if(frame.size >= HELLO_STAMPED_SIZE)
+	{
+		memcpy(&echo, &frame.payload[LINK_MSG_SIZE + 4], 2);
+		
+		if(echo != 0 && (uint16_t)(recv_time - echo) < RTT_MAX_SAMPLE)
+		{
+			update_rtt(link, recv_time - echo);
+			printf("rtt: %u ms (smoothed %u, jitter %u)\n", (uint16_t)(recv_time - echo), LINK_SRTT(link), LINK_RTTVAR(link));
+		}
+	}
 	
 	//Reply to this HELLO message if necessary
-	if (reply || (recv_time - link->rtable[rtable_idx].last_ping_recvd) > IGNORE_PING_UNDER)
+	if ((uint16_t)(recv_time - link->neighbour.last_ping_recvd) > IGNORE_PING_UNDER)
+		reply = 1;
+	
+	//Remember the neighbour's stamp before replying, so the reply echoes the freshest one
+	link->neighbour.last_ping_recvd = recv_time;
+	if(frame.size >= HELLO_STAMPED_SIZE)
+		memcpy(&link->neighbour.peer_stamp, &frame.payload[LINK_MSG_SIZE + 2], 2);
+	
+	//Peers from before FEC send shorter HELLOs, and never get FEC frames
+	link->fec_peer = (frame.size >= HELLO_SIZE) ? frame.payload[LINK_MSG_SIZE + 6] : 0;
+	link_set_fec(link, link->fec_wanted);
+	
+	if (reply)
 	{
 		printf("Replying to PROBE...\n");
 		send_hello(link->id, end_id, link);
@@ -298,11 +419,9 @@ uint8_t parse_hello_msg(FRAME frame, LINK *link)
 	else
 		printf("No need to reply to HELLO\n");
 	
-	link->rtable[rtable_idx].last_ping_recvd = recv_time;
-	
 	
 	//call user's handler
-	hello_handler(frame);
+	dispatch_frame_event(HELLO_EVENT, frame, link);
 
 	
 	return 1;
@@ -316,14 +435,14 @@ uint8_t parse_join_msg(FRAME frame, LINK *link)
 	
 	//Add the node's routing information to the table. The same index as its ID is used.
 	update_rtable_entry(new_id, new_hops, link);
-	printf("Received NJOIN from %d, %d hops\n", new_id, link->rtable[new_id].hops);
+	printf("Received NJOIN from %d, %d hops\n", new_id, RT_HOPS(link, new_id));
 	
 	//TODO: If switch, forward the packet to everyone else. Implement in the switch code
 	//Reply with the current routing table If I'm the switch. 
 
 	
 	//call user's handler
-	join_handler(frame);
+	dispatch_frame_event(JOIN_EVENT, frame, link);
 	
 	return 1;
 }
@@ -340,10 +459,8 @@ uint8_t parse_leave_msg(FRAME frame, LINK *link)
 	update_rtable_entry(leave_id, 0, link);
 	printf("Received LEAVE from %u, %u\n", leave_id, reason);
 	
-	//TODO: If switch, forward the packet to everyone else. Implement in the switch code
-	
 	//call user's handler
-	leave_handler(frame);
+	dispatch_frame_event(LEAVE_EVENT, frame, link);
 	
 	return 1;
 }
@@ -351,19 +468,28 @@ uint8_t parse_leave_msg(FRAME frame, LINK *link)
 
 uint8_t parse_rtble_msg(FRAME frame, LINK *link)
 {
-	uint8_t entries = (uint8_t)frame.payload[LINK_MSG_SIZE];
+	uint8_t entries, version;
 	uint8_t i, curid, curhops, readidx;		
 	
 	//Switches do not parse anyone else's routing table
-	if(link->link_type == GATEWAY) 
+	if(link->link_type == GATEWAY || frame.size < RTBLE_HEADER_SIZE) 
 		return 0;
 	
-	printf("Received RTBLE with %d entries!\n", entries);
+	//A corrupt count must not take the loop past the payload
+	entries = (uint8_t)frame.payload[LINK_MSG_SIZE];
+	entries = min(entries, (frame.size - RTBLE_HEADER_SIZE) / NODE_LENGTH);
+	version = (uint8_t)frame.payload[LINK_MSG_SIZE + 1];
+	
+	printf("Received RTBLE v%d with %d entries!\n", version, entries);
+	
+	//A full table replaces everything learned so far. Entry 0 is the link itself
+	for(i = find_successor(1, link); i != 0; i = find_successor(i + 1, link))
+		update_rtable_entry(i, 0, link);
 	
 	for(i=0; i<entries; i++)
 	{
 		//Parse the next routing entry out of the message payload
-		readidx = LINK_MSG_SIZE + 1 + NODE_LENGTH*i;
+		readidx = RTBLE_HEADER_SIZE + NODE_LENGTH*i;
 		curid = (uint8_t)frame.payload[readidx];
 		curhops = (uint8_t)frame.payload[readidx + 1];
 		
@@ -373,23 +499,109 @@ uint8_t parse_rtble_msg(FRAME frame, LINK *link)
 			update_rtable_entry(curid, curhops, link);	
 	}
 	
+	//We are now in sync with the sender
+	link->rt_version = version;
+	send_rtack_msg(version, link);
+	
 	//Call User's handler
-	rtble_handler(frame);
+	dispatch_frame_event(RTBLE_EVENT, frame, link);
 	
 	return 1;
 }
 
 
+uint8_t parse_rtdlt_msg(FRAME frame, LINK *link)
+{
+	uint8_t entries, from_version, to_version;
+	uint8_t i, curid, curhops, readidx;
+	
+	//Switches do not parse anyone else's routing table
+	if(link->link_type == GATEWAY || frame.size < RTDLT_HEADER_SIZE) 
+		return 0;
+	
+	//A corrupt count must not take the loop past the payload
+	entries = (uint8_t)frame.payload[LINK_MSG_SIZE];
+	entries = min(entries, (frame.size - RTDLT_HEADER_SIZE) / NODE_LENGTH);
+	from_version = (uint8_t)frame.payload[LINK_MSG_SIZE + 1];
+	to_version = (uint8_t)frame.payload[LINK_MSG_SIZE + 2];
+	
+	printf("Received RTDLT v%d->v%d with %d entries!\n", from_version, to_version, entries);
+	
+	//Deltas carry absolute values, so one starting at or before our version can be applied. Anything else is a gap.
+	if(link->rt_version == 0 || (uint8_t)(link->rt_version - from_version) > (uint8_t)(to_version - from_version))
+	{
+		printf("Routing version gap (have v%d)! Requesting full table\n", link->rt_version);
+		send_reqrt_msg(0, link);
+		return 0;
+	}
+	
+	for(i=0; i<entries; i++)
+	{
+		readidx = RTDLT_HEADER_SIZE + NODE_LENGTH*i;
+		curid = (uint8_t)frame.payload[readidx];
+		curhops = (uint8_t)frame.payload[readidx + 1];
+		
+		if(curid == link->id || curid >= RTABLE_LENGTH)
+			continue;
+		
+		//0 hops means the node has left
+		if(curhops > 0 || RT_HOPS(link, curid) > 0)
+			update_rtable_entry(curid, curhops, link);
+	}
+	
+	link->rt_version = to_version;
+	send_rtack_msg(to_version, link);
+	
+	//Deltas are routing table updates as far as the user is concerned
+	dispatch_frame_event(RTBLE_EVENT, frame, link);
+	
+	return 1;
+}
+
+
+uint8_t parse_rtack_msg(FRAME frame, LINK *link)
+{
+	if(frame.size <= LINK_MSG_SIZE)
+		return 0;
+	
+	//The other end is now in sync up to this version
+	link->rt_version = (uint8_t)frame.payload[LINK_MSG_SIZE];
+	printf("Received RTACK v%d from %d\n", link->rt_version, frame.src);
+	
+	return 1;
+}
+
+
+
+//Track group membership behind the link. Nodes ignore these, they never receive them
+uint8_t parse_group_msg(FRAME frame, LINK *link, uint8_t join)
+{
+	uint8_t group = (uint8_t)frame.payload[LINK_MSG_SIZE];
+	
+	if(frame.size <= LINK_MSG_SIZE || group >= MAX_GROUPS)
+		return 0;
+	
+	if(join)
+		link->groups |= GROUP_BIT(group);
+	else
+		link->groups &= ~GROUP_BIT(group);
+	
+	printf("Node %u %s group %u\n", frame.src, join ? "joined" : "left", group);
+	
+	return 1;
+}
+
 
 uint8_t parse_reqrt_msg(FRAME frame, LINK *link)
 {
 	
-	//Reply with the current routing table.
-	printf("Received REQRT from %d, %d hops\n", frame.src);
-	send_rtble_msg(frame.src, link);
+	//Reply with the current routing table. Switches reply with the table from all of their links instead
+	printf("Received REQRT from %d\n", frame.src);
+	if(link->link_type != GATEWAY)
+		send_rtble_msg(frame.src, link);
 	
 	//call user's handler
-	reqrt_handler(frame);
+	dispatch_frame_event(REQRT_EVENT, frame, link);
 	
 	return 1;
 }
@@ -427,7 +639,33 @@ CMSG_T parse_control_frame(FRAME frame, LINK *link)
 	{
 		printf("Found REQRT message!\n");
 		parse_reqrt_msg(frame, link);
-		return Rtble_Frame;
+		return Reqrt_Frame;
+	}
+	else if(strncmp(frame.payload, RTDELTA_PREAMBLE, LINK_MSG_SIZE) == 0)
+	{
+		printf("Found RTDLT message!\n");
+		parse_rtdlt_msg(frame, link);
+		return Rtdlt_Frame;
+	}
+	else if(strncmp(frame.payload, RTACK_PREAMBLE, LINK_MSG_SIZE) == 0)
+	{
+		parse_rtack_msg(frame, link);
+		return Rtack_Frame;
+	}
+	else if(strncmp(frame.payload, DVECT_PREAMBLE, LINK_MSG_SIZE) == 0)
+	{
+		//Distance vectors only concern switches, which parse them against all of their links
+		return Dvect_Frame;
+	}
+	else if(strncmp(frame.payload, GJOIN_PREAMBLE, LINK_MSG_SIZE) == 0)
+	{
+		parse_group_msg(frame, link, 1);
+		return Gjoin_Frame;
+	}
+	else if(strncmp(frame.payload, GLEAVE_PREAMBLE, LINK_MSG_SIZE) == 0)
+	{
+		parse_group_msg(frame, link, 0);
+		return Gleave_Frame;
 	}
 	else if(strncmp(frame.payload, LEAVE_PREAMBLE, LINK_MSG_SIZE) == 0)
 	{
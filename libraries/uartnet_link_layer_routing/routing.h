@@ -11,7 +11,7 @@
 Control Frames
 *******************************/
 
-typedef enum {Invalid_CFrame = 0, Hello_Frame, Join_Frame, Rtble_Frame, Leave_Frame} CMSG_T;
+typedef enum {Invalid_CFrame = 0, Hello_Frame, Join_Frame, Rtble_Frame, Leave_Frame, Reqrt_Frame, Rtdlt_Frame, Rtack_Frame, Dvect_Frame, Gjoin_Frame, Gleave_Frame} CMSG_T;
 
 //Link Layer messages
 #define LINK_MSG_SIZE               	6
@@ -20,14 +20,48 @@ typedef enum {Invalid_CFrame = 0, Hello_Frame, Join_Frame, Rtble_Frame, Leave_Fr
 #define REQRT_PREAMBLE			((const char*) "!REQRT")
 #define ROUTING_PREAMBLE		((const char*) "!RTBLE")
 #define LEAVE_PREAMBLE          ((const char*) "!LEAVE")
+#define RTDELTA_PREAMBLE		((const char*) "!RTDLT")
+#define RTACK_PREAMBLE			((const char*) "!RTACK")
+#define DVECT_PREAMBLE			((const char*) "!DVECT")		//Switch-to-switch distance vector
+#define GJOIN_PREAMBLE			((const char*) "!GJOIN")		//Subscribe to a multicast group
+#define GLEAVE_PREAMBLE			((const char*) "!GLEAV")		//Unsubscribe from a multicast group
 
 //For PROBE messages
 #define SWITCH_LINK_SYMBOL				's'
 #define NODE_LINK_SYMBOL				'n'
+#define HELLO_STAMPED_SIZE				(LINK_MSG_SIZE + 6)		//preamble + type + nonce + stamp + echo
+#define HELLO_SIZE						(LINK_MSG_SIZE + 7)		//... + FEC flags
+#define HELLO_FEC_CAPABLE				0x01					//We decode FEC frames
+#define HELLO_FEC_WANTED				0x02					//We want FEC on this link
+
+//RTT measurement and latency metric
+#define RTT_MAX_SAMPLE					5000		//Samples above this (ms) are stale echoes and ignored
+#define LINK_SRTT(link)					((link)->neighbour.srtt >> 3)
+#define LINK_RTTVAR(link)				((link)->neighbour.rttvar >> 2)
+#define RT_DEFAULT_COST					10			//Cost (ms) assumed for a link whose RTT has not been measured yet
+#define RT_METRIC_UNREACHABLE			0xFFFF
 
 //For LEAVE messages (Leave Reason)
 #define	UNEXPECTED_LEAVE				0x00
 #define NOREASON_LEAVE					0x01
+#define TIMEOUT_LEAVE					0x02		//Sent by a switch on behalf of a node it declared dead
+
+
+//For RTBLE/RTDLT messages
+#define RTBLE_HEADER_SIZE				(LINK_MSG_SIZE + 2)		//preamble + entries + version
+#define RTDLT_HEADER_SIZE				(LINK_MSG_SIZE + 3)		//preamble + entries + from version + to version
+#ifndef RT_DELTA_WINDOW
+#define RT_DELTA_WINDOW					128						//Versions further apart than this always get a full RTBLE. 0 sends only full tables
+#endif
+
+//For DVECT messages
+#define DVECT_HEADER_SIZE				(LINK_MSG_SIZE + 1)		//preamble + entries
+#define DVECT_ENTRY_LENGTH				4						//id + hops + 16-bit latency metric
+#define RT_HYSTERESIS_MS				2						//Smallest latency improvement (ms) worth switching paths for
+#define RT_INFINITY						15						//Hop count treated as unreachable. Bounds count-to-infinity, and fits a nibble
+
+//Random tag carried in a switch's HELLO, so a switch can recognize its own HELLO echoed back on a looped link
+extern uint8_t hello_nonce;
 
 
 /*******************************
@@ -41,18 +75,38 @@ Active Monitorings
 //#define IGNORE_PING_UNDER		5000			//currently in MS, to be changed to TICKS
 
 
-#define TICK_MS					5000000		//In MS; 3 seconds per tick
+//Heartbeat. The timer only counts ticks; missed-tick bookkeeping, pings and LEAVEs run from the main loop.
+//A silent node is pinged after PING_TICKS and declared dead after PING_TICKS_THRESHOLD ticks, so death is
+//detected at most DEAD_DETECT_MAX_MS after the last frame heard from it (the extra tick is timer phase).
+#ifndef TICK_US
+#define TICK_US					5000000UL	//Timer1 period in us; 5 seconds per tick
+#endif
+#ifndef PING_TICKS
 #define PING_TICKS				3			
+#endif
+#ifndef PING_TICKS_THRESHOLD
 #define PING_TICKS_THRESHOLD	5	
+#endif
 #define IGNORE_PING_UNDER		10000		//currently in MS, to be changed to TICKS
+#define DEAD_DETECT_MAX_MS		((PING_TICKS_THRESHOLD + 1) * (TICK_US / 1000))
+
+#if PING_TICKS_THRESHOLD > RT_MAX_TICKS
+#error "PING_TICKS_THRESHOLD does not fit the rtable tick nibble"
+#endif
+#if PING_TICKS * TICK_US / 1000 <= IGNORE_PING_UNDER
+#error "Pings sent every PING_TICKS would be ignored by the node"
+#endif
 
 
 /*******************************
 User Functions?
 *******************************/
 CMSG_T parse_control_frame(FRAME frame, LINK *link);
+uint8_t update_rtable_entry(uint8_t id, uint8_t hops, LINK *link);
 uint8_t find_successor(uint8_t id, LINK *link);
 uint8_t find_predecessor(uint8_t id, LINK *link);
+uint8_t rtable_count(LINK *link);
+uint16_t link_cost(LINK *link);
 
 
 /*******************************
@@ -65,5 +119,7 @@ uint8_t send_join_msg(uint8_t my_id, LINK *link);
 uint8_t send_leave_msg(uint8_t id, uint8_t reason, LINK *link);
 uint8_t send_rtble_msg(uint8_t dst, LINK *link);
 uint8_t send_reqrt_msg(uint8_t dst, LINK *link);
+uint8_t send_rtack_msg(uint8_t version, LINK *link);
+uint8_t send_group_msg(uint8_t my_id, uint8_t group, uint8_t join, LINK *link);
 
 #endif
\ No newline at end of file
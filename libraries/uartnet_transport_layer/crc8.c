@@ -2,27 +2,21 @@
 
 #include "crc8.h"
 
+//Polynomial 0x07 applied to each high nibble, so a byte takes two lookups instead of eight shifts. 16 bytes of RAM
+static const uint8_t crc8_nibble[16] = {
+	0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
+
 //Calculate the  crc8 for a single byte
 //Let inCRC be 0 if it's the first piece
 unsigned char crc8 ( unsigned char inCrc, unsigned char inData )
 {
-	unsigned char   i;
     unsigned char   data;
 
     data = inCrc ^ inData;
-
-	for ( i = 0; i < 8; i++ )
-    {
-        if (( data & 0x80 ) != 0 )
-        {
-            data <<= 1;
-            data ^= 0x07;
-        }
-        else
-        {
-            data <<= 1;
-        }
-	}
+    data = (data << 4) ^ crc8_nibble[data >> 4];
+    data = (data << 4) ^ crc8_nibble[data >> 4];
 
 	return data;
 }
@@ -40,4 +34,18 @@ uint8_t crc8_block( uint8_t crc, uint8_t *data, unsigned int len )
 
     return crc;
 
-}
\ No newline at end of file
+}
+
+
+//Copy a block and accumulate its crc8 in the same pass, so checking data that gets copied anyway costs nothing extra
+uint8_t crc8_copy( uint8_t crc, uint8_t *dst, const uint8_t *src, unsigned int len )
+{
+    while ( len > 0 )
+    {
+        *dst = *src++;
+        crc = crc8( crc, *dst++ );
+        len--;
+    }
+
+    return crc;
+}
@@ -6,7 +6,16 @@
 
 #define INITIAL_CRC 0x0
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 unsigned char crc8 ( unsigned char inCrc, unsigned char inData );
 uint8_t crc8_block( unsigned char crc, unsigned char *data, unsigned int len );
+uint8_t crc8_copy( uint8_t crc, uint8_t *dst, const uint8_t *src, unsigned int len );
+
+#ifdef __cplusplus
+}
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -12,11 +12,21 @@ UMPACKET create_umpacket(uint8_t src, uint8_t dst, uint8_t size, uchar *payload)
 {
 	UMPACKET packet;
 	
+	//Size check
+	if(size > UMPACKET_MAX_PAYLOAD)
+	{
+		printf("create_umpacket: Payload size exceeds maximum!\n");
+		size = UMPACKET_MAX_PAYLOAD;
+	}
+	
 	//Primary Header Fields
 	packet.src 				= src;					
 	packet.dst 				= dst;
-	packet.size 			= size;			
-
+	packet.payload_size 	= size;					//Calculated from the frame size by frame.size - UMPACKET_HEADER_EXTRA
+	
+	//Secondary Header Fields
+	packet.type 			= UMPACKET_PREAMBLE;
+	
 	packet.payload 			= payload;
 	
 	return packet;
@@ -31,7 +41,7 @@ UMPACKET create_umpacket(uint8_t src, uint8_t dst, uint8_t size, uchar *payload)
 Unreliable Stream Packets
 ***************************/
 
-USPACKET create_uspacket(uint8_t src, uint8_t dst, uint16_t id, uint8_t total_size, uint16_t payload_offset, uint8_t payload_size, uchar *payload)
+USPACKET create_uspacket(uint8_t src, uint8_t dst, uint16_t id, uint16_t total_size, uint16_t payload_offset, uint8_t payload_size, uchar *payload)
 {
 	USPACKET packet;
 	
@@ -137,29 +147,23 @@ RSPACKET create_rspacket(uint16_t preamble, uint8_t src, uint8_t dst, uint8_t pa
 	packet.payload = payload;
 	
 
-	/*
-	//generate CRC8 checksum of the header 
-	packet.checksum = crc8_block(INITIAL_CRC, (uchar*) &packet, RSPACKET_HEADER_SIZE);
-	
-	//generate the CRC of the payload by continuing with the header's checksum
-	if(packet.payload != NULL)
-		packet.checksum = crc8_block(packet.checksum, (uchar*) packet.payload, packet.size);
-	*/
-	packet.checksum = 0xFF;
+	//Filled in by send_rspacket(), while it serialises the packet
+	packet.checksum = 0;
 	
 	return packet;
 }
 
-RSPACKET create_rspacket_syn(uint8_t src, uint8_t dst, uint32_t stream_size)
+//The stream size travels in the 32-bit offset field, since payload_size is only 8 bits wide. The caller picks the id
+RSPACKET create_rspacket_syn(uint8_t src, uint8_t dst, uint16_t id, uint32_t stream_size)
 {	
-	srand((unsigned) time(NULL));
-	return create_rspacket(RSPACKET_SYN_PREAMBLE, src, dst, stream_size, (uint16_t)rand(), 0, NULL);
+	return create_rspacket(RSPACKET_SYN_PREAMBLE, src, dst, 0, id, stream_size, NULL);
 }
 
 
-RSPACKET create_rspacket_ack(uint8_t src, uint8_t dst, uint8_t payload_size, uint16_t id, uint32_t payload_offset)
+//The payload, if any, is the receiver's SACK bitmap
+RSPACKET create_rspacket_ack(uint8_t src, uint8_t dst, uint8_t payload_size, uint16_t id, uint32_t payload_offset, uchar *payload)
 {	
-	return create_rspacket(RSPACKET_ACK_PREAMBLE, src, dst, payload_size, id, payload_offset, NULL);
+	return create_rspacket(RSPACKET_ACK_PREAMBLE, src, dst, payload_size, id, payload_offset, payload);
 }
 
 
@@ -169,6 +173,16 @@ RSPACKET create_rspacket_data(uint8_t src, uint8_t dst, uint8_t payload_size, ui
 }
 
 
+//End-to-end check of a reliable packet: CRC-8 over both addresses, the secondary header up to the checksum, then the
+//payload. The payload is left to the caller, to fold into the copy it makes of it anyway (see crc8_copy())
+uint8_t rspacket_header_crc(uint8_t src, uint8_t dst, uchar *header)
+{
+	uint8_t crc = crc8(INITIAL_CRC, (dst << ADDRESS_WIDTH) | src);
+
+	return crc8_block(crc, header, RSPACKET_HEADER_EXTRA - 1);
+}
+
+
 RSPACKET frame_to_rspacket(FRAME frame)
 {
 	RSPACKET packet;
@@ -181,8 +195,8 @@ RSPACKET frame_to_rspacket(FRAME frame)
 	//Extract the secondary headers
 	packet.type = *((uint16_t*)&frame.payload[0]);
 	packet.id = *((uint16_t*)&frame.payload[2]);
-	packet.payload_offset = *((uint16_t*)&frame.payload[4]);
-	packet.checksum = *((uint16_t*)&frame.payload[8]);
+	packet.payload_offset = *((uint32_t*)&frame.payload[4]);
+	packet.checksum = frame.payload[RSPACKET_HEADER_EXTRA - 1];
 	
 	//Copy the payload without the secondary headers
 	packet.payload = &frame.payload[RSPACKET_HEADER_EXTRA]; //good idea? maybe use memmov to remove the uneeded bytes?
@@ -234,12 +248,15 @@ void print_rspacket(RSPACKET packet)
 	{
 		case RSPACKET_SYN_PREAMBLE:
 			printf("(SYN)\n");
-			printf("Total Stream Size: %X\n", packet.payload_size);
+			printf("Total Stream Size: %lX\n", (unsigned long)packet.payload_offset);
 			break;
 		
 		case RSPACKET_ACK_PREAMBLE:
 			printf("(ACK)\n");
-			printf("Acked byte: %X\n", packet.payload_size);
+			printf("Acked byte: %lX\n", (unsigned long)packet.payload_offset);
+			printf("SACK: ");
+			print_bytes(packet.payload, packet.payload_size);
+			printf("\n");
 			break;
 		
 		case RSPACKET_DATA_PREAMBLE:
@@ -21,20 +21,21 @@
 
 
 //secondary header size in bytes
-#define USPACKET_HEADER_EXTRA 		(PREAMBLE_WIDTH + ID_WIDTH + 2*USTREAM_SIZE_WIDTH) /8
-#define RSPACKET_HEADER_EXTRA 		(PREAMBLE_WIDTH + ID_WIDTH + RSTREAM_SIZE_WIDTH + CHECKSUM_WIDTH) /8
+#define UMPACKET_HEADER_EXTRA 		(PREAMBLE_WIDTH /8)
+#define USPACKET_HEADER_EXTRA 		((PREAMBLE_WIDTH + ID_WIDTH + 2*USTREAM_SIZE_WIDTH) /8)
+#define RSPACKET_HEADER_EXTRA 		((PREAMBLE_WIDTH + ID_WIDTH + RSTREAM_SIZE_WIDTH + CHECKSUM_WIDTH) /8)
 
 
 //Total header size. +1 for "STX"
-#define UMPACKET_HEADER_TOTAL    	FRAME_HEADER_SIZE 
-#define USPACKET_HEADER_TOTAL    	FRAME_HEADER_SIZE + 1 + USPACKET_HEADER_EXTRA
-#define RSPACKET_HEADER_TOTAL    	FRAME_HEADER_SIZE + 1 + RSPACKET_HEADER_EXTRA
+#define UMPACKET_HEADER_TOTAL    	(FRAME_HEADER_SIZE + 1 + UMPACKET_HEADER_EXTRA)
+#define USPACKET_HEADER_TOTAL    	(FRAME_HEADER_SIZE + 1 + USPACKET_HEADER_EXTRA)
+#define RSPACKET_HEADER_TOTAL    	(FRAME_HEADER_SIZE + 1 + RSPACKET_HEADER_EXTRA)
 
 
 //max payload size
-#define UMPACKET_MAX_PAYLOAD		MAX_PAYLOAD_SIZE
-#define USPACKET_MAX_PAYLOAD		MAX_PAYLOAD_SIZE - USPACKET_HEADER_EXTRA
-#define RSPACKET_MAX_PAYLOAD		MAX_PAYLOAD_SIZE - RSPACKET_HEADER_EXTRA
+#define UMPACKET_MAX_PAYLOAD		(MAX_PAYLOAD_SIZE - UMPACKET_HEADER_EXTRA)
+#define USPACKET_MAX_PAYLOAD		(MAX_PAYLOAD_SIZE - USPACKET_HEADER_EXTRA)
+#define RSPACKET_MAX_PAYLOAD		(MAX_PAYLOAD_SIZE - RSPACKET_HEADER_EXTRA)
 
 
 
@@ -43,8 +44,20 @@ Unreliable Message Packets
 ***************************/
 
 
-//UMPACKET is essentially a bare frame in the transport layer.
-typedef FRAME UMPACKET;
+//A single-frame message. Its type word is all the header it has, so the receiver tells it from the other packets
+typedef struct {
+	
+	//Primary Header Fields
+	unsigned int src			: ADDRESS_WIDTH;
+	unsigned int dst			: ADDRESS_WIDTH;
+	unsigned int payload_size   : PAYLOAD_SIZE_WIDTH;
+	
+	//Secondary Header Fields
+	unsigned int type    		: PREAMBLE_WIDTH;
+	
+	unsigned char *payload;
+	
+} __attribute__((packed)) UMPACKET;
 
 
 
@@ -104,9 +117,9 @@ extern "C" {
 
 
 UMPACKET create_umpacket(uint8_t src, uint8_t dst, uint8_t size, uchar *payload);
-USPACKET create_uspacket(uint8_t src, uint8_t dst, uint16_t id, uint8_t total_size, uint16_t payload_offset, uint8_t payload_size, uchar *payload);
-RSPACKET create_rspacket_syn(uint8_t src, uint8_t dst, uint32_t stream_size);
-RSPACKET create_rspacket_ack(uint8_t src, uint8_t dst, uint8_t payload_size, uint16_t id, uint32_t payload_offset);
+USPACKET create_uspacket(uint8_t src, uint8_t dst, uint16_t id, uint16_t total_size, uint16_t payload_offset, uint8_t payload_size, uchar *payload);
+RSPACKET create_rspacket_syn(uint8_t src, uint8_t dst, uint16_t id, uint32_t stream_size);
+RSPACKET create_rspacket_ack(uint8_t src, uint8_t dst, uint8_t payload_size, uint16_t id, uint32_t payload_offset, uchar *payload);
 RSPACKET create_rspacket_data(uint8_t src, uint8_t dst, uint8_t payload_size, uint16_t id, uint32_t payload_offset, uchar *payload);
 
 
@@ -116,6 +129,7 @@ void print_uspacket(USPACKET packet);
 
 //FRAME rspacket_to_frame(RSPACKET packet);
 RSPACKET frame_to_rspacket(FRAME frame);
+uint8_t rspacket_header_crc(uint8_t src, uint8_t dst, uchar *header);
 void print_rspacket(RSPACKET packet);
 
 
@@ -6,16 +6,57 @@
   Front-end Functions
 ***************************/
 
-TRANSPORT transport_initialize()
+void transport_initialize(TRANSPORT *tr, uint8_t my_id, LINK *link)
 {
-  TRANSPORT tr;
-   
-  memset(tr.recvd_queue, 0, MAX_RECEIVED_BUF*sizeof(RECVD_DATA));
+  memset(tr, 0, sizeof(TRANSPORT));
+  tr->my_id = my_id;
+  tr->link = link;
+  tr->us_next_id = random(1, 0x10000);
+}
+
+
+void transport_join_group(TRANSPORT *tr, uint8_t group)
+{
+  if (group >= MAX_GROUPS)
+    return;
+
+  tr->groups |= GROUP_BIT(group);
+  send_group_msg(tr->my_id, group, 1, tr->link);
+}
+
+
+void transport_leave_group(TRANSPORT *tr, uint8_t group)
+{
+  if (group >= MAX_GROUPS)
+    return;
+
+  tr->groups &= ~GROUP_BIT(group);
+  send_group_msg(tr->my_id, group, 0, tr->link);
+}
+
+
+//Hand a completed transfer to the user. Returns 0 if the queue is full
+uint8_t push_recvd(TRANSPORT *tr, RECVD_DATA data)
+{
+  if (tr->recvd_count == MAX_RECEIVED_BUF)
+    return 0;
+
+  tr->recvd_queue[(tr->recvd_head + tr->recvd_count) % MAX_RECEIVED_BUF] = data;
+  tr->recvd_count++;
+  return 1;
+}
 
-  //in_streams = calloc(MAX_INBOUND_STREAMS, sizeof(CONNECTION));
- // out_streams = calloc(MAX_OUTBOUND_STREAMS, sizeof(CONNECTION));
- 
-	return tr;
+
+//Oldest completed transfer. It is the user's to release with transport_free()
+uint8_t transport_recv(TRANSPORT *tr, RECVD_DATA *data)
+{
+  if (tr->recvd_count == 0)
+    return 0;
+
+  *data = tr->recvd_queue[tr->recvd_head];
+  tr->recvd_head = (tr->recvd_head + 1) % MAX_RECEIVED_BUF;
+  tr->recvd_count--;
+  return 1;
 }
 
 
@@ -23,48 +64,66 @@ TRANSPORT transport_initialize()
 /***************************
   Receive from Link Layer
 ***************************/
-//assumes frame.payload was malloc'd
-
-//Process a frame received from the link layer. 
-RECVD_DATA parse_recvd_frame(FRAME frame)
-{
-	RECVD_DATA recvd;
-	uint16_t type = *((uint16_t*)&frame.payload[0]);
-	
-	//Todo: add to transport receive queue
-	switch(type)
-	{
-		case USPACKET_PREAMBLE:
-			recvd.type = MESSAGE_TYPE;
-			recvd.data.message.payload = frame.payload;
-			break;
-			
-		
-		case RSPACKET_SYN_PREAMBLE:
-		case RSPACKET_ACK_PREAMBLE:
-			recvd.type = STREAM_REQ_TYPE;
-			recvd.data.stream_req = frame_to_rspacket(frame);
-			break;
-		
-		
-		case RSPACKET_DATA_PREAMBLE:
-			recvd.type = MESSAGE_TYPE;
-			recvd.data.message.payload = frame.payload;
-			break;
-
-		
-		//Treat all else as UMPACKETs
-		default:
-			recvd.type = MESSAGE_TYPE;
-			recvd.data.message.payload = frame.payload;
-			
-			printf("\n*****\n");
-			print_frame(frame);
-			printf("\n*****\n");
-			break;
-	}
-
-  return recvd;
+
+//Reads whatever the port has, emptying the link's receive queue as it fills. One read_serial() only takes about a
+//frame's worth of bytes, so a single one per call would fall behind a busy line. Frames from the switch are the link
+//layer's business
+uint8_t transport_check_recv(TRANSPORT *tr)
+{
+  FRAME frame;
+  uint8_t count = 0;
+
+  do
+  {
+    read_serial(tr->link);
+
+    while (tr->link->rqueue_pending > 0)
+    {
+      frame = pop_recv_queue(tr->link);
+      count++;
+
+      if (frame.src == 0 || frame.preamble == CFRAME_PREAMBLE)
+      {
+        parse_control_frame(frame, tr->link);
+        free(frame.payload);
+      }
+      //Same as the node: multicasts for groups we are not in never reach the user
+      else if (frame.preamble == GFRAME_PREAMBLE && !(tr->groups & GROUP_BIT(frame.dst)))
+        free(frame.payload);
+      else
+        transport_recv_frame(tr, frame);
+    }
+  } while (tr->link->port->available() > 0 && count < TRANSPORT_PUMP_FRAMES);
+
+  return count;
+}
+
+
+//Single-frame messages keep the frame's own buffer, so they reach the user without a copy. Returns 0 if dropped
+uint8_t deliver_frame(TRANSPORT *tr, FRAME frame, uint8_t header)
+{
+  RECVD_DATA recvd;
+
+  recvd.type = MESSAGE_TYPE;
+  recvd.data.message.src = frame.src;
+  recvd.data.message.dst = frame.dst;
+  recvd.data.message.size = frame.size - header;
+  recvd.data.message.payload = &frame.payload[header];
+  recvd.data.message.buffer = frame.payload;
+
+  if (push_recvd(tr, recvd))
+    return 1;
+
+  tr->recvd_dropped++;
+  return 0;
+}
+
+
+void transport_free(RECVD_DATA *data)
+{
+  free(data->data.message.buffer);
+  data->data.message.buffer = NULL;
+  data->data.message.payload = NULL;
 }
 
 
@@ -76,8 +135,20 @@ RECVD_DATA parse_recvd_frame(FRAME frame)
 
 int send_umpacket(UMPACKET packet, LINK *link)
 {
-	//return create_send_frame(packet.src, packet.dst, packet.size, packet.payload, link);
-	return send_frame((FRAME)packet, link);
+	FRAME frame;
+	int retval;
+	
+	frame = create_frame(packet.src, packet.dst, (packet.payload_size + UMPACKET_HEADER_EXTRA), NULL);
+	frame.payload = malloc(frame.size);
+	
+	//The type word, then the payload. Skip src, dst, payload_size
+	memcpy(frame.payload, &(((uchar*)&packet)[2]), UMPACKET_HEADER_EXTRA);
+	memcpy(&frame.payload[UMPACKET_HEADER_EXTRA], packet.payload, packet.payload_size);
+	
+	retval = send_frame(frame, link);
+	free(frame.payload);
+	
+	return retval;
 }
 
 
@@ -115,11 +186,9 @@ int send_rspacket(RSPACKET packet, LINK *link)
 	
 	/*** rspacket_to_frame ***/
 
-	//Determine the actual payload size for the FRAME. SYN/ACK packets only have the secondary headers in the frame payload.
-	if(packet.type == RSPACKET_DATA_PREAMBLE) 
-		actual_pl_size = packet.payload_size + RSPACKET_HEADER_EXTRA;
-	else 
-		actual_pl_size = RSPACKET_HEADER_EXTRA;
+	//Determine the actual payload size for the FRAME. SYN packets only have the secondary headers in the frame payload,
+	//ACKs may carry a SACK bitmap after them
+	actual_pl_size = packet.payload_size + RSPACKET_HEADER_EXTRA;
 	
 	//Create a new frame to encapsulate the RSPACKET
 	frame = create_frame(packet.src, packet.dst, actual_pl_size, NULL);
@@ -130,9 +199,9 @@ int send_rspacket(RSPACKET packet, LINK *link)
 	//Copy the secondary header fields into the beginning of the payload. Skip src, dst, payload_size
 	memcpy(frame.payload, &(((uchar*)&packet)[2]), RSPACKET_HEADER_EXTRA);
 	
-	//Append the remaining payload if it's a DATA packet
-	if(packet.type == RSPACKET_DATA_PREAMBLE)
-		memcpy(&frame.payload[RSPACKET_HEADER_EXTRA], packet.payload, packet.payload_size);
+	//Append the remaining payload, if any, summing it up on the way into the checksum
+	frame.payload[RSPACKET_HEADER_EXTRA - 1] = crc8_copy(rspacket_header_crc(packet.src, packet.dst, frame.payload),
+		&frame.payload[RSPACKET_HEADER_EXTRA], packet.payload, packet.payload_size);
 	
 	/*************************/
 	
@@ -146,9 +215,761 @@ int send_rspacket(RSPACKET packet, LINK *link)
 
 
 
+/***************************
+  Unreliable Messages
+***************************/
+
+uint8_t transport_send_message(TRANSPORT *tr, uint8_t dst, uchar *data, uint16_t size)
+{
+  US_OUTBOUND *msg;
+
+  if (dst == 0 || size == 0 || tr->us_out_count == US_MAX_OUTBOUND)
+    return 0;
+
+  msg = &tr->us_out[(tr->us_out_head + tr->us_out_count) % US_MAX_OUTBOUND];
+  msg->dst = dst;
+  msg->id = tr->us_next_id++;
+  msg->size = size;
+  msg->sent = 0;
+  msg->data = data;
+
+  if (tr->us_next_id == 0)
+    tr->us_next_id = 1;
+
+  tr->us_out_count++;
+  return 1;
+}
+
+
+uint8_t transport_messages_queued(TRANSPORT *tr)
+{
+  return tr->us_out_count;
+}
+
+
+//Fragment the queued messages, oldest first, for as long as the link has room for them
+void us_sender_task(TRANSPORT *tr)
+{
+  US_OUTBOUND *msg;
+  uint8_t size;
+
+  while (tr->us_out_count > 0 && tr->link->squeue_pending < SEND_QUEUE_SIZE)
+  {
+    msg = &tr->us_out[tr->us_out_head];
+    size = min(US_FRAGMENT_SIZE, msg->size - msg->sent);
+
+    if (!send_uspacket(create_uspacket(tr->my_id, msg->dst, msg->id, msg->size, msg->sent, size, &msg->data[msg->sent]),
+                       tr->link))
+      break;
+
+    msg->sent += size;
+    if (msg->sent == msg->size)
+    {
+      tr->us_out_head = (tr->us_out_head + 1) % US_MAX_OUTBOUND;
+      tr->us_out_count--;
+    }
+  }
+}
+
+
+//Give a reassembly's blocks back to the pool, and the slot with them
+void us_release(TRANSPORT *tr, uint8_t slot)
+{
+  uint16_t b;
+
+  for (b = 0; b < US_POOL_BLOCKS && tr->reassembly[slot].fragments > 0; b++)
+  {
+    if (tr->us_block_owner[b] == slot + 1)
+    {
+      tr->us_block_owner[b] = 0;
+      tr->reassembly[slot].fragments--;
+      tr->us_blocks_used--;
+    }
+  }
+
+  tr->reassembly[slot].state = RA_FREE;
+}
+
+
+//Copy a complete message out of the pool and hand it to the user. Returns 0 if the received queue is full
+uint8_t us_deliver(TRANSPORT *tr, uint8_t slot)
+{
+  REASSEMBLY *ra = &tr->reassembly[slot];
+  RECVD_DATA done;
+  unsigned long latency;
+  uint32_t offset;
+  uint16_t b;
+  uchar *buffer;
+
+  if (tr->recvd_count == MAX_RECEIVED_BUF)
+    return 0;
+
+  buffer = (uchar*)malloc(ra->total_size);
+  if (buffer == NULL)
+    return 0;
+
+  for (b = 0; b < US_POOL_BLOCKS; b++)
+  {
+    if (tr->us_block_owner[b] == slot + 1)
+    {
+      offset = (uint32_t)tr->us_block_index[b] * US_FRAGMENT_SIZE;
+      memcpy(&buffer[offset], tr->us_pool[b], min(US_FRAGMENT_SIZE, ra->total_size - offset));
+    }
+  }
+
+  done.type = MESSAGE_TYPE;
+  done.data.message.src = ra->src;
+  done.data.message.dst = tr->my_id;
+  done.data.message.size = ra->total_size;
+  done.data.message.payload = buffer;
+  done.data.message.buffer = buffer;
+  push_recvd(tr, done);
+
+  latency = millis() - ra->first;
+  tr->us_delivered++;
+  tr->us_latency_total += latency;
+  tr->us_latency_max = max(tr->us_latency_max, latency);
+
+  us_release(tr, slot);
+  return 1;
+}
+
+
+//Under pressure, the message that went longest without a fragment gives way. Fragments leave the sender in order,
+//so a message overtaken by a newer one is most likely missing some already. Returns the freed slot, or
+//US_MAX_REASSEMBLY if nothing could go
+uint8_t us_evict(TRANSPORT *tr, uint8_t keep, uint8_t need_blocks)
+{
+  unsigned long now = millis();
+  uint8_t slot, oldest = US_MAX_REASSEMBLY;
+  REASSEMBLY *ra;
+
+  for (slot = 0; slot < US_MAX_REASSEMBLY; slot++)
+  {
+    ra = &tr->reassembly[slot];
+
+    if (slot == keep || (ra->state != RA_COLLECTING && ra->state != RA_DROPPED) || (need_blocks && ra->fragments == 0))
+      continue;
+
+    if (oldest == US_MAX_REASSEMBLY || now - ra->last > now - tr->reassembly[oldest].last)
+      oldest = slot;
+  }
+
+  if (oldest < US_MAX_REASSEMBLY)
+  {
+    if (tr->reassembly[oldest].state == RA_COLLECTING)
+      tr->us_evicted++;
+    us_release(tr, oldest);
+  }
+
+  return oldest;
+}
+
+
+//The slot collecting a message, or a new one for it. Returns US_MAX_REASSEMBLY if all are taken
+uint8_t us_find_slot(TRANSPORT *tr, USPACKET packet)
+{
+  uint8_t slot = tr->us_last_slot[packet.src], free_slot = US_MAX_REASSEMBLY;
+  REASSEMBLY *ra;
+
+  //Sources send their messages one after the other, so their fragments nearly always go where the last one did
+  ra = &tr->reassembly[slot];
+  if (ra->state != RA_FREE && ra->src == packet.src && ra->id == packet.id)
+    return slot;
+
+  for (slot = 0; slot < US_MAX_REASSEMBLY; slot++)
+  {
+    if (tr->reassembly[slot].state == RA_FREE)
+    {
+      if (free_slot == US_MAX_REASSEMBLY)
+        free_slot = slot;
+    }
+    else if (tr->reassembly[slot].src == packet.src && tr->reassembly[slot].id == packet.id)
+    {
+      tr->us_last_slot[packet.src] = slot;
+      return slot;
+    }
+  }
+
+  if (free_slot == US_MAX_REASSEMBLY)
+    free_slot = us_evict(tr, US_MAX_REASSEMBLY, 0);
+  if (free_slot == US_MAX_REASSEMBLY)
+    return free_slot;
+
+  tr->us_last_slot[packet.src] = free_slot;
+  ra = &tr->reassembly[free_slot];
+  memset(ra, 0, sizeof(REASSEMBLY));
+  ra->state = RA_COLLECTING;
+  ra->src = packet.src;
+  ra->id = packet.id;
+  ra->total_size = packet.total_size;
+  ra->first = ra->last = millis();
+
+  //Messages bigger than the whole pool are turned away from the start
+  if ((packet.total_size + US_FRAGMENT_SIZE - 1) / US_FRAGMENT_SIZE > US_POOL_BLOCKS)
+  {
+    printf("Cannot reassemble a %u byte message from %u\n", packet.total_size, packet.src);
+    ra->state = RA_DROPPED;
+  }
+
+  return free_slot;
+}
+
+
+//The first pool block not holding a fragment. Returns US_POOL_BLOCKS if there is none
+uint16_t us_free_block(TRANSPORT *tr)
+{
+  uint16_t b;
+
+  for (b = 0; b < US_POOL_BLOCKS; b++)
+    if (tr->us_block_owner[b] == 0)
+      return b;
+
+  return US_POOL_BLOCKS;
+}
+
+
+//Fragments may come in any order. Each goes to the pool block matching its place in the message. Returns 1 if the
+//frame's buffer was kept: a message that fits one fragment is delivered in it, without going through the pool
+uint8_t us_recv_fragment(TRANSPORT *tr, FRAME frame)
+{
+  USPACKET packet = frame_to_uspacket(frame);
+  REASSEMBLY *ra;
+  uint16_t index = packet.payload_offset / US_FRAGMENT_SIZE;
+  uint16_t expected, b;
+  uint8_t slot;
+
+  //Every fragment but the last is full-size, so the offset alone says where it goes
+  if (packet.total_size == 0 || packet.payload_offset % US_FRAGMENT_SIZE != 0 ||
+      packet.payload_offset >= packet.total_size ||
+      packet.payload_size != min(US_FRAGMENT_SIZE, packet.total_size - packet.payload_offset))
+    return 0;
+
+  if (packet.payload_size == packet.total_size)
+  {
+    if (!deliver_frame(tr, frame, USPACKET_HEADER_EXTRA))
+      return 0;
+
+    tr->us_delivered++;
+    return 1;
+  }
+
+  slot = us_find_slot(tr, packet);
+  if (slot == US_MAX_REASSEMBLY)
+  {
+    tr->us_dropped++;
+    return 0;
+  }
+
+  ra = &tr->reassembly[slot];
+  if (ra->state == RA_DROPPED)
+    tr->us_dropped++;
+  if (ra->state != RA_COLLECTING || ra->total_size != packet.total_size)
+    return 0;
+
+  for (b = 0; b < US_POOL_BLOCKS; b++)
+    if (tr->us_block_owner[b] == slot + 1 && tr->us_block_index[b] == index)
+      return 0;
+
+  b = us_free_block(tr);
+  while (b == US_POOL_BLOCKS && us_evict(tr, slot, 1) < US_MAX_REASSEMBLY)
+    b = us_free_block(tr);
+
+  //Without room for this fragment the message can never complete, so it gives up its blocks right away
+  if (b == US_POOL_BLOCKS)
+  {
+    tr->us_dropped++;
+    us_release(tr, slot);
+    ra->state = RA_DROPPED;
+    ra->last = millis();
+    return 0;
+  }
+
+  memcpy(tr->us_pool[b], packet.payload, packet.payload_size);
+  tr->us_block_owner[b] = slot + 1;
+  tr->us_block_index[b] = index;
+  tr->us_blocks_used++;
+  tr->us_blocks_high = max(tr->us_blocks_high, tr->us_blocks_used);
+
+  ra->fragments++;
+  ra->last = millis();
+
+  expected = (packet.total_size + US_FRAGMENT_SIZE - 1) / US_FRAGMENT_SIZE;
+  if (ra->fragments == expected)
+  {
+    ra->state = RA_COMPLETE;
+    us_deliver(tr, slot);
+  }
+
+  return 0;
+}
+
+
+//Retry deliveries held back by a full received queue, and drop messages whose fragments stopped coming
+void us_receiver_task(TRANSPORT *tr)
+{
+  unsigned long now = millis();
+  uint8_t slot;
+
+  for (slot = 0; slot < US_MAX_REASSEMBLY; slot++)
+  {
+    if (tr->reassembly[slot].state == RA_COMPLETE && us_deliver(tr, slot))
+      continue;
+
+    if (tr->reassembly[slot].state != RA_FREE && now - tr->reassembly[slot].last >= US_REASSEMBLY_TIMEOUT_MS)
+    {
+      if (tr->reassembly[slot].state != RA_DROPPED)
+        tr->us_expired++;
+      us_release(tr, slot);
+    }
+  }
+}
+
+
+
+
+/***************************
+  Reliable Streams
+***************************/
+
+//Segments to keep in flight: enough to cover the path's delay at the link's line rate, plus one for the ACK's way back.
+//The lowest RTT is used rather than the smoothed one, or the queueing caused by a big window would grow it further
+uint8_t rs_window(CONNECTION *conn)
+{
+  uint8_t window;
+
+  if (conn->rtt_min == 0)
+    return 1;
+
+  window = conn->rtt_min / RS_SEGMENT_MS + 1;
+  return min(window, RS_MAX_WINDOW);
+}
+
+
+//Same estimator as the link's (update_rtt in routing.cpp, RFC 6298): srtt is kept x8 and rttvar x4 so the 1/8 and
+//1/4 gains do not truncate small deltas away. Only samples timing a full segment count towards the path delay, since
+//the window is sized in segments
+void rs_rtt_sample(CONNECTION *conn, uint16_t sample, uint8_t segment)
+{
+  int16_t delta;
+
+  //Keeps srtt x8 within 16 bits
+  sample = min(sample, (uint16_t)RS_MAX_RTO_MS);
+
+  if (conn->srtt == 0)
+  {
+    conn->srtt = sample << 3;
+    conn->rttvar = sample << 1;
+  }
+  else
+  {
+    delta = sample - CONN_SRTT(conn);
+    conn->srtt += delta;
+
+    if (delta < 0)
+      delta = -delta;
+    conn->rttvar += delta - CONN_RTTVAR(conn);
+  }
+
+  if (segment && (conn->rtt_min == 0 || sample < conn->rtt_min))
+    conn->rtt_min = sample;
+
+  conn->rto = constrain(CONN_SRTT(conn) + 4 * CONN_RTTVAR(conn), RS_MIN_RTO_MS, RS_MAX_RTO_MS);
+}
+
+
+//A timeout. Returns 0 once the stream has failed too many times in a row
+uint8_t rs_backoff(TRANSPORT *tr, CONNECTION *conn)
+{
+  tr->rs_timeouts++;
+
+  if (++conn->failed_packets > RS_MAX_RETRIES)
+  {
+    printf("Stream %u to %u failed at byte %lu\n", conn->id, conn->target, (unsigned long)conn->last_ack);
+    conn->state = CONN_FAILED;
+    return 0;
+  }
+
+  //Karn: the segment in flight may now be sent twice, so it cannot be timed
+  conn->rto = min(conn->rto * 2, RS_MAX_RTO_MS);
+  conn->probe_time = 0;
+  conn->timer = millis();
+  return 1;
+}
+
+
+//The cumulative ACK, followed by the SACK bitmap, least significant byte first
+uint8_t rs_send_ack(TRANSPORT *tr, CONNECTION *conn)
+{
+  uchar sack[4];
+  uint8_t i;
+
+  for (i = 0; i < RS_SACK_BYTES; i++)
+    sack[i] = conn->sacked >> (8 * i);
+
+  return send_rspacket(create_rspacket_ack(tr->my_id, conn->target, RS_SACK_BYTES, conn->id, conn->last_ack, sack),
+                       tr->link);
+}
+
+
+uint8_t transport_send_stream(TRANSPORT *tr, uint8_t dst, uchar *data, uint32_t size)
+{
+  CONNECTION *conn;
+
+  if (dst == 0 || dst >= MAX_ADDRESS || dst >= MAX_OUTBOUND_STREAMS || size == 0)
+    return 0;
+
+  conn = &tr->out_streams[dst];
+  if (conn->state == CONN_SYN_SENT || conn->state == CONN_OPEN)
+    return 0;
+
+  //The path is the same as last time, so what was learnt about its RTT still holds
+  if (conn->srtt == 0)
+  {
+    memset(conn, 0, sizeof(CONNECTION));
+    conn->rto = RS_INITIAL_RTO_MS;
+  }
+
+  conn->reliable = 1;
+  conn->state = CONN_SYN_SENT;
+  conn->target = dst;
+  conn->id = random(1, 0x10000);
+  conn->total_size = size;
+  conn->last_ack = 0;
+  conn->last_transferred = 0;
+  conn->highest_sent = 0;
+  conn->lost_upto = 0;
+  conn->sacked = 0;
+  conn->failed_packets = 0;
+  conn->probe_time = 0;
+  conn->buffer = data;
+  conn->timer = millis();
+
+  send_rspacket(create_rspacket_syn(tr->my_id, dst, conn->id, size), tr->link);
+  return 1;
+}
+
+
+uint8_t transport_stream_state(TRANSPORT *tr, uint8_t dst)
+{
+  return (dst < MAX_OUTBOUND_STREAMS) ? tr->out_streams[dst].state : (uint8_t)CONN_IDLE;
+}
+
+
+//Was the segment at offset reported as received by the last ACK?
+uint8_t rs_sacked(CONNECTION *conn, uint32_t offset)
+{
+  uint32_t bit = (offset - conn->last_ack) / RS_SEGMENT_SIZE;
+
+  return bit > 0 && bit <= RS_SACK_SEGMENTS && (conn->sacked >> (bit - 1)) & 1;
+}
+
+
+uint8_t rs_send_segment(TRANSPORT *tr, CONNECTION *conn, uint32_t offset, unsigned long now)
+{
+  uint8_t size = min(RS_SEGMENT_SIZE, conn->total_size - offset);
+
+  if (!send_rspacket(create_rspacket_data(tr->my_id, conn->target, size, conn->id, offset, &conn->buffer[offset]),
+                     tr->link))
+    return 0;
+
+  //The timer runs for the oldest unacknowledged segment
+  if (offset == conn->last_ack)
+    conn->timer = now;
+
+  tr->rs_bytes_sent += size;
+  if (offset < conn->highest_sent)
+  {
+    tr->rs_bytes_resent += size;
+
+    //Karn: the ACK for a segment sent twice cannot time either
+    if (offset < conn->probe_ack)
+      conn->probe_time = 0;
+  }
+
+  return 1;
+}
+
 
+//Resend the holes known to be lost, then keep the window full of new segments. Without SACK, every unacknowledged
+//segment counts as a hole once the timer runs out, which is go-back-N
+void rs_sender_task(TRANSPORT *tr, CONNECTION *conn)
+{
+  unsigned long now = millis();
+  uint32_t offset;
+
+  if (conn->state == CONN_SYN_SENT)
+  {
+    if (now - conn->timer >= conn->rto && rs_backoff(tr, conn))
+      send_rspacket(create_rspacket_syn(tr->my_id, conn->target, conn->id, conn->total_size), tr->link);
+    return;
+  }
+
+  if (conn->state != CONN_OPEN)
+    return;
+
+  if (conn->highest_sent > conn->last_ack && now - conn->timer >= conn->rto)
+  {
+    if (!rs_backoff(tr, conn))
+      return;
+
+    //The receiver may have dropped what it SACKed (RFC 2018), so everything unacknowledged goes again
+    conn->lost_upto = conn->highest_sent;
+    conn->last_transferred = conn->last_ack;
+    conn->sacked = 0;
+  }
+
+  for (offset = max(conn->last_transferred, conn->last_ack); offset < conn->lost_upto; offset += RS_SEGMENT_SIZE)
+  {
+    if (rs_sacked(conn, offset))
+      continue;
+
+    if (tr->link->squeue_pending == SEND_QUEUE_SIZE || !rs_send_segment(tr, conn, offset, now))
+      break;
+  }
+  conn->last_transferred = offset;
+
+  while (conn->highest_sent < conn->total_size && tr->link->squeue_pending < SEND_QUEUE_SIZE &&
+         conn->highest_sent - conn->last_ack < (uint32_t)rs_window(conn) * RS_SEGMENT_SIZE)
+  {
+    if (!rs_send_segment(tr, conn, conn->highest_sent, now))
+      break;
+
+    conn->highest_sent = min(conn->highest_sent + RS_SEGMENT_SIZE, conn->total_size);
+
+    //Only segments sent for the first time are timed
+    if (conn->probe_time == 0)
+    {
+      conn->probe_ack = conn->highest_sent;
+      conn->probe_time = now;
+    }
+  }
+}
+
+
+void rs_recv_ack(TRANSPORT *tr, RSPACKET packet)
+{
+  CONNECTION *conn = &tr->out_streams[packet.src];
+  unsigned long now = millis();
+  uint32_t sacked = 0;
+  uint8_t i;
+
+  if (packet.src >= MAX_OUTBOUND_STREAMS || conn->id != packet.id)
+    return;
+
+  //The handshake is timed too, unless the SYN had to be sent again
+  if (conn->state == CONN_SYN_SENT)
+  {
+    if (conn->failed_packets == 0)
+      rs_rtt_sample(conn, now - conn->timer, 0);
 
+    conn->state = CONN_OPEN;
+    conn->failed_packets = 0;
+    return;
+  }
 
+  //Old ACKs, and anything beyond what was ever sent
+  if (conn->state != CONN_OPEN || packet.payload_offset < conn->last_ack || packet.payload_offset > conn->highest_sent)
+    return;
 
+  for (i = 0; i < RS_SACK_BYTES && i < packet.payload_size; i++)
+    sacked |= (uint32_t)packet.payload[i] << (8 * i);
+
+  //Nothing new: a duplicate
+  if (packet.payload_offset == conn->last_ack && sacked == conn->sacked)
+    return;
+
+  if (conn->probe_time != 0 && packet.payload_offset >= conn->probe_ack)
+  {
+    rs_rtt_sample(conn, now - conn->probe_time, conn->probe_ack - conn->last_ack >= RS_SEGMENT_SIZE);
+    conn->probe_time = 0;
+  }
+
+  conn->last_ack = packet.payload_offset;
+  conn->sacked = sacked;
+  conn->failed_packets = 0;
+  conn->timer = now;
+
+  //The line never reorders frames, so a hole below a SACKed segment was lost, and is resent without waiting for the
+  //timer. The highest set bit gives the last segment the receiver got. Bits past what was ever sent are noise
+  if (sacked)
+  {
+    conn->lost_upto = max(conn->lost_upto, conn->last_ack +
+                         (8 * sizeof(unsigned long) - __builtin_clzl((unsigned long)sacked)) * RS_SEGMENT_SIZE);
+    conn->lost_upto = min(conn->lost_upto, conn->highest_sent);
+  }
+
+  if (conn->last_ack == conn->total_size)
+    conn->state = CONN_DONE;
+}
+
+
+//Hand a complete stream to the user. Returns 0 if the received queue is full, to try again later
+uint8_t rs_deliver(TRANSPORT *tr, CONNECTION *conn)
+{
+  RECVD_DATA done;
+
+  done.type = MESSAGE_TYPE;
+  done.data.message.src = conn->target;
+  done.data.message.dst = tr->my_id;
+  done.data.message.size = conn->total_size;
+  done.data.message.payload = conn->buffer;
+  done.data.message.buffer = conn->buffer;
+
+  if (!push_recvd(tr, done))
+    return 0;
+
+  conn->state = CONN_DONE;
+  conn->buffer = NULL;
+  return 1;
+}
+
+
+void rs_recv_syn(TRANSPORT *tr, RSPACKET packet)
+{
+  CONNECTION *conn = &tr->in_streams[packet.src];
 
+  //A repeated SYN for the current stream only needs answering again
+  if (conn->id != packet.id || (conn->state != CONN_OPEN && conn->state != CONN_DONE))
+  {
+    //A finished stream still waiting for room in the received queue goes first. Until it is delivered, the new SYN
+    //goes unanswered and the sender tries it again
+    if (conn->state == CONN_OPEN && conn->last_ack == conn->total_size && !rs_deliver(tr, conn))
+      return;
 
+    //The sender has given up on the stream we were receiving
+    if (conn->state == CONN_OPEN)
+      free(conn->buffer);
+
+    memset(conn, 0, sizeof(CONNECTION));
+    conn->buffer = (uchar*)malloc(packet.payload_offset);
+    if (packet.payload_offset == 0 || conn->buffer == NULL)
+    {
+      printf("Cannot receive a %lu byte stream from %u\n", (unsigned long)packet.payload_offset, packet.src);
+      free(conn->buffer);
+      conn->buffer = NULL;
+      return;
+    }
+
+    conn->reliable = 1;
+    conn->state = CONN_OPEN;
+    conn->target = packet.src;
+    conn->id = packet.id;
+    conn->total_size = packet.payload_offset;
+  }
+
+  rs_send_ack(tr, conn);
+}
+
+
+//In-order segments move the cumulative ACK. Later ones within the SACK bitmap's reach are kept and marked, and anything
+//else is dropped. Either way the sender learns how far we are. The payload is checked while it is copied into the
+//stream, starting from the header's crc. Only segments we do not hold yet are copied, so a bad one overwrites nothing
+//and simply stays missing, to be sent again
+void rs_recv_data(TRANSPORT *tr, RSPACKET packet, uint8_t crc)
+{
+  CONNECTION *conn = &tr->in_streams[packet.src];
+  uint32_t bit;
+
+  if (conn->id != packet.id || (conn->state != CONN_OPEN && conn->state != CONN_DONE))
+    return;
+
+  //Segments start on segment boundaries, and only the last one is short
+  if (conn->state == CONN_OPEN && packet.payload_offset % RS_SEGMENT_SIZE == 0 &&
+      packet.payload_offset >= conn->last_ack && packet.payload_offset < conn->total_size &&
+      packet.payload_size == min(RS_SEGMENT_SIZE, conn->total_size - packet.payload_offset))
+  {
+    bit = (packet.payload_offset - conn->last_ack) / RS_SEGMENT_SIZE;
+
+    if (bit <= RS_SACK_SEGMENTS && (bit == 0 || !(conn->sacked & ((uint32_t)1 << (bit - 1)))))
+    {
+      if (crc8_copy(crc, &conn->buffer[packet.payload_offset], packet.payload, packet.payload_size) != packet.checksum)
+        tr->rs_bad_checksums++;
+      else if (bit > 0)
+        conn->sacked |= (uint32_t)1 << (bit - 1);
+      else
+      {
+        conn->last_ack += packet.payload_size;
+
+        //Take in the segments that were waiting for this one
+        while (conn->sacked & 1)
+        {
+          conn->sacked >>= 1;
+          conn->last_ack = min(conn->last_ack + RS_SEGMENT_SIZE, conn->total_size);
+        }
+        conn->sacked >>= 1;
+
+        if (conn->last_ack == conn->total_size)
+          rs_deliver(tr, conn);
+      }
+    }
+  }
+
+  rs_send_ack(tr, conn);
+}
+
+
+//Run a frame received for us through the packet type's engine. Stream packets find their connection by the peer's
+//address and are checked against its id; fragments find their message's reassembly by (src, id). Frames of any other
+//type are dropped. Takes over frame.payload: it is either freed or handed to the user
+void transport_recv_frame(TRANSPORT *tr, FRAME frame)
+{
+  RSPACKET packet;
+  uint8_t crc;
+  uint16_t type = (frame.size >= 2) ? *((uint16_t*)&frame.payload[0]) : 0;
+
+  switch (type)
+  {
+    case UMPACKET_PREAMBLE:
+      if (frame.size >= UMPACKET_HEADER_EXTRA && deliver_frame(tr, frame, UMPACKET_HEADER_EXTRA))
+        return;
+      break;
+
+    case USPACKET_PREAMBLE:
+      if (frame.size >= USPACKET_HEADER_EXTRA && us_recv_fragment(tr, frame))
+        return;
+      break;
+
+    case RSPACKET_SYN_PREAMBLE:
+    case RSPACKET_ACK_PREAMBLE:
+    case RSPACKET_DATA_PREAMBLE:
+      if (frame.size < RSPACKET_HEADER_EXTRA || frame.src >= MAX_INBOUND_STREAMS)
+        break;
+
+      //SYNs and ACKs are checked here. DATA payloads are checked as they are copied into their stream
+      packet = frame_to_rspacket(frame);
+      crc = rspacket_header_crc(frame.src, frame.dst, frame.payload);
+      if (type != RSPACKET_DATA_PREAMBLE && crc8_block(crc, packet.payload, packet.payload_size) != packet.checksum)
+        tr->rs_bad_checksums++;
+      else if (type == RSPACKET_SYN_PREAMBLE)
+        rs_recv_syn(tr, packet);
+      else if (type == RSPACKET_ACK_PREAMBLE)
+        rs_recv_ack(tr, packet);
+      else
+        rs_recv_data(tr, packet, crc);
+      break;
+
+    default:
+      tr->recvd_bad_types++;
+      break;
+  }
+
+  free(frame.payload);
+}
+
+
+void transport_task(TRANSPORT *tr)
+{
+  uint8_t i;
+
+  for (i = 1; i < MAX_OUTBOUND_STREAMS; i++)
+    rs_sender_task(tr, &tr->out_streams[i]);
+
+  //Streams that completed while the received queue was full
+  for (i = 1; i < MAX_INBOUND_STREAMS; i++)
+    if (tr->in_streams[i].state == CONN_OPEN && tr->in_streams[i].last_ack == tr->in_streams[i].total_size)
+      rs_deliver(tr, &tr->in_streams[i]);
+
+  us_sender_task(tr);
+  us_receiver_task(tr);
+}
@@ -7,10 +7,64 @@
 //#include "../link_layer/link.h"
 #include <link.h>
 
-//Max concurrent connections
-#define MAX_INBOUND_STREAMS			MAX_ADDRESS + 1
-#define MAX_OUTBOUND_STREAMS		MAX_ADDRESS + 1
+//Streams are indexed by the address of the other end, so only peers below these can stream with us. A CONNECTION takes
+//about 52 bytes on AVR: the 32 of the full address space come to 1.6 KB, too much next to the link's buffers on a 2 KB
+//ATmega328, so AVR builds only stream with nodes 1 to 3 unless told otherwise
+#ifndef MAX_INBOUND_STREAMS
+#ifdef __AVR__
+#define MAX_INBOUND_STREAMS			4
+#define MAX_OUTBOUND_STREAMS		4
+#else
+#define MAX_INBOUND_STREAMS			(MAX_ADDRESS + 1)
+#define MAX_OUTBOUND_STREAMS		(MAX_ADDRESS + 1)
+#endif
+#endif
 #define MAX_RECEIVED_BUF        	8
+#define TRANSPORT_PUMP_FRAMES		32			//Most frames one transport_check_recv() takes, so the caller gets to send too
+
+//Reliable streams
+#define RS_SEGMENT_SIZE				RSPACKET_MAX_PAYLOAD
+#define RS_MAX_WINDOW				6			//Segments in flight. The link's send queue holds 8 frames
+#define RS_INITIAL_RTO_MS			500			//Until the first RTT sample
+#define RS_MIN_RTO_MS				50
+#define RS_MAX_RTO_MS				4000
+#define RS_MAX_RETRIES				8			//Consecutive timeouts before a stream is given up on
+
+//Segments past the cumulative ACK that an ACK can report as received, at most 32. With 0, ACKs are cumulative only
+//and the sender goes back to the oldest unacknowledged byte on a loss
+#ifndef RS_SACK_SEGMENTS
+#define RS_SACK_SEGMENTS			16
+#endif
+
+#if RS_SACK_SEGMENTS > 32
+#error "RS_SACK_SEGMENTS must be 32 or less"
+#endif
+
+#define RS_SACK_BYTES				((RS_SACK_SEGMENTS + 7) / 8)
+
+#ifndef RS_LINK_BAUD
+#define RS_LINK_BAUD				115200
+#endif
+
+//Time a full DATA segment spends on the wire, 10 bits per byte
+#define RS_SEGMENT_MS				((RSPACKET_HEADER_TOTAL + RS_SEGMENT_SIZE + 1) * 10000UL / RS_LINK_BAUD)
+
+//Unreliable messages
+#define US_FRAGMENT_SIZE			USPACKET_MAX_PAYLOAD
+#define US_MAX_OUTBOUND				4			//Messages waiting to be fragmented
+#define US_MAX_REASSEMBLY			4			//Messages being put back together at once. The stalest gives way to new ones
+#define US_REASSEMBLY_TIMEOUT_MS	1000		//A message is dropped when none of its fragments arrived for this long
+
+//Fragments wait in a pool of fragment-sized blocks until their message is complete. Size it for the largest message
+//expected: a 64 KB one takes 266 blocks. Each block costs US_FRAGMENT_SIZE + 3 bytes (250), so AVR builds keep 4, for
+//messages of up to 988 bytes. With the stream defaults above, a TRANSPORT is then about 1.7 KB on AVR instead of 6 KB
+#ifndef US_POOL_BLOCKS
+#ifdef __AVR__
+#define US_POOL_BLOCKS				4
+#else
+#define US_POOL_BLOCKS				16
+#endif
+#endif
 
 //Representing completed transfers
 typedef struct {
@@ -20,6 +74,7 @@ typedef struct {
 	uint32_t size    	: RSTREAM_SIZE_WIDTH;
 	
 	uchar* payload;				
+	uchar* buffer;				//What to free once done with the payload, which may start inside it. See transport_free()
 	
 } MESSAGE;
 
@@ -46,41 +101,121 @@ typedef struct {
 
 
 
-//transport layer stuff
+enum CONN_STATE {CONN_IDLE = 0, CONN_SYN_SENT, CONN_OPEN, CONN_DONE, CONN_FAILED};
+
+//Connection states for inbound/outbound stream connections
 typedef struct {
+
+	uint8_t reliable :1;		//1 = reliable stream; 0 = unreliable stream
+	uint8_t state;				//See CONN_STATE
+	uint8_t	target;				//target receiver/sender
+	uint16_t id;				//ID of the stream connection
 	
-	//Streams that are still in-flight
-	//static CONNECTION *in_streams;
-	//static CONNECTION *out_streams;
+	uint32_t total_size;		//Total size of the stream to be transferred
+	uint32_t last_ack;			//Last ACK number received (if sender) / Sent (if receiver)
+	uint32_t last_transferred;	//Where to look for the next hole to resend (if sender)
+	uint32_t highest_sent;		//Bytes sent at least once. Anything below is a retransmission (if sender)
+	uint32_t lost_upto;			//Segments below this that were not SACKed are lost (if sender)
+	uint32_t sacked;			//Bit i set: the (i+1)th segment after last_ack is held by the receiver
 	
-	//Buffer for received messages or completed streams waiting to be read by the user
-	RECVD_DATA recvd_queue[MAX_RECEIVED_BUF];
-	int recvd_count;
+	uint8_t failed_packets;		//How many consecutive failures so far?
+	uint16_t srtt;				//Smoothed RTT with the target, in 1/8 ms. 0 until the first sample
+	uint16_t rttvar;			//RTT variation, in 1/4 ms
+	uint16_t rtt_min;			//Lowest RTT seen: the path's delay without queueing
+	uint16_t rto;				//Retransmission timeout, in ms
+	
+	uint32_t probe_ack;			//ACK that will time the segment being measured, and when it went out. 0 = none
+	unsigned long probe_time;
+	unsigned long timer;		//When the oldest unacknowledged segment (or the SYN) went out
 	
+	uchar* buffer;				//Where are the stream payloads stored at?
+	
+} CONNECTION;
 
-}TRANSPORT;
+#define CONN_SRTT(conn)				((conn)->srtt >> 3)
+#define CONN_RTTVAR(conn)			((conn)->rttvar >> 2)
 
 
 
 
+//A message being fragmented
+typedef struct {
 
-//Connection states for inbound/outbound stream connections
+	uint8_t dst;
+	uint16_t id;
+	uint16_t size;
+	uint16_t sent;				//Bytes already handed to the link
+	uchar *data;
+
+} US_OUTBOUND;
+
+
+enum REASSEMBLY_STATE {RA_FREE = 0, RA_COLLECTING, RA_COMPLETE, RA_DROPPED};
+
+//A message being put back together. Its fragments are the pool blocks it owns
 typedef struct {
 
-	uint8_t reliable :1;		//1 = reliable stream; 0 = unreliable stream
-	uint8_t	target;				//target receiver/sender
-	uint16_t id;				//ID of the stream connection
+	uint8_t state;				//See REASSEMBLY_STATE. Complete ones wait for room in the received queue, dropped ones
+								//turn away the rest of their fragments until they time out
+	uint8_t src;
+	uint16_t id;
+	uint16_t total_size;
+	uint16_t fragments;			//Fragments received so far
+	unsigned long first;		//When the first fragment arrived
+	unsigned long last;			//When the latest one did
+
+} REASSEMBLY;
+
+
+
+
+//transport layer stuff
+typedef struct {
 	
-	uint16_t total_size;		//Total size of the stream to be transferred
-	uint16_t last_ack;			//Last ACK number received (if sender) / Sent (if receiver)
-	uint16_t last_transferred;	//Offset of last payload send (if sender) / received (if received)
+	uint8_t my_id;
+	LINK *link;
+	GROUP_MASK groups;					//Multicast groups joined. Group frames for any other are dropped
 	
-	uint8_t failed_packets;		//How many consecutive failures so far?
-	uint16_t rtt;				//Average RTT with the target
+	//Streams, indexed by the address of the other end. One of each direction per peer
+	CONNECTION in_streams[MAX_INBOUND_STREAMS];
+	CONNECTION out_streams[MAX_OUTBOUND_STREAMS];
 	
-	uchar* buffer;				//Where are the stream payloads stored at?
+	//Buffer for received messages or completed streams waiting to be read by the user
+	RECVD_DATA recvd_queue[MAX_RECEIVED_BUF];
+	int recvd_count;
+	int recvd_head;
+	unsigned long recvd_dropped;		//Single-frame messages lost to a full queue
+	unsigned long recvd_bad_types;		//Frames of no known packet type, i.e. with a corrupted type word, dropped
 	
-} CONNECTION;
+	//Reliable stream counters
+	unsigned long rs_bytes_sent;		//DATA payload bytes, retransmissions included
+	unsigned long rs_bytes_resent;
+	unsigned long rs_timeouts;
+	unsigned long rs_bad_checksums;	//Received packets that failed their end-to-end check and were dropped
+	
+	//Unreliable messages: a queue of outbound ones, and the inbound ones under reassembly
+	US_OUTBOUND us_out[US_MAX_OUTBOUND];
+	uint8_t us_out_count;
+	uint8_t us_out_head;
+	uint16_t us_next_id;
+	
+	REASSEMBLY reassembly[US_MAX_REASSEMBLY];
+	uint8_t us_last_slot[MAX_ADDRESS + 1];		//Slot of the latest message from each source, checked before the others
+	uchar us_pool[US_POOL_BLOCKS][US_FRAGMENT_SIZE];
+	uint8_t us_block_owner[US_POOL_BLOCKS];		//Reassembly slot + 1, 0 if the block is free
+	uint16_t us_block_index[US_POOL_BLOCKS];	//Which fragment of its message the block holds
+	uint16_t us_blocks_used;
+	
+	//Unreliable message counters
+	unsigned long us_delivered;
+	unsigned long us_dropped;			//Fragments turned away: no reassembly slot or pool block was left for them
+	unsigned long us_expired;			//Messages that timed out with fragments missing
+	unsigned long us_evicted;			//Incomplete messages pushed out by newer ones, for a reassembly slot or pool blocks
+	unsigned long us_latency_total;		//First fragment to delivery, in ms, summed over delivered messages
+	unsigned long us_latency_max;
+	uint16_t us_blocks_high;			//Most pool blocks ever in use at once
+
+}TRANSPORT;
 
 
 
@@ -88,11 +223,30 @@ typedef struct {
 extern "C" {
 #endif
 
-TRANSPORT transport_initialize();
+void transport_initialize(TRANSPORT *tr, uint8_t my_id, LINK *link);
+
+
+//Receive pump: reads the link, and runs every frame through the transport layer. Returns how many frames it took
+uint8_t transport_check_recv(TRANSPORT *tr);
+void transport_recv_frame(TRANSPORT *tr, FRAME frame);
+uint8_t transport_recv(TRANSPORT *tr, RECVD_DATA *data);
+void transport_free(RECVD_DATA *data);
+
+
+//Multicast groups, announced on the transport's link
+void transport_join_group(TRANSPORT *tr, uint8_t group);
+void transport_leave_group(TRANSPORT *tr, uint8_t group);
+
+
+//Reliable streams. The data must stay untouched until the stream is CONN_DONE or CONN_FAILED
+uint8_t transport_send_stream(TRANSPORT *tr, uint8_t dst, uchar *data, uint32_t size);
+uint8_t transport_stream_state(TRANSPORT *tr, uint8_t dst);
+void transport_task(TRANSPORT *tr);
 
 
-RECVD_DATA parse_recvd_frame(FRAME frame);
-void transport_check_recv(TRANSPORT *tr);
+//Unreliable messages. The data must stay untouched until transport_messages_queued() no longer counts it
+uint8_t transport_send_message(TRANSPORT *tr, uint8_t dst, uchar *data, uint16_t size);
+uint8_t transport_messages_queued(TRANSPORT *tr);
 
 
 int send_umpacket(UMPACKET packet, LINK *link);
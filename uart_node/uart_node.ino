@@ -10,32 +10,32 @@
 //Others
 #define NET_INIT_DELAY 1000
 
-LINK *link;
-
-//Declared in led_cycler.cpp
-extern uint8_t led_intensity;
-extern uint8_t led_on;
+DEMO demo;
 
 
 //Overrides the message frame handler, so we can parse commands specific to our application
-void mframe_parser(FRAME frame)
+void mframe_parser(const FRAME &frame, LINK *link, void *ctx)
 {
+  DEMO *demo = (DEMO*)ctx;
+
   if (strncmp(frame.payload, "!TLED", 5) == 0)
   {
     printf("!TLED from %u\n", frame.src);
-    toggle_led();
+    toggle_led(demo);
   }
 }
 
 //Callback for JOIN, LEAVE, and RTBLE. Needed by LED cycler
-void route_update_parser(FRAME frame)
+void route_update_parser(const FRAME &frame, LINK *link, void *ctx)
 {
-  led_peer_update();
+  led_peer_update((DEMO*)ctx);
 }
 
 
 void setup()
 {
+  LINK *link;
+
   //Initialize GPIOs
   pinMode(DEMO_LED_PIN, OUTPUT);      //Demo LED
   pinMode(ACTIVITY_LED_PIN, OUTPUT);  //Link Activity LED
@@ -48,15 +48,15 @@ void setup()
 
   //Setup the network
   delay(NET_INIT_DELAY);                  //Give the switch a bit of time to initialize
-  link = node_init(MY_ID, mframe_parser);
-  set_join_handler(route_update_parser);
-  set_leave_handler(route_update_parser);
-  set_rtble_handler(route_update_parser);
-  send_join_msg(link->id, link);
+  link = node_init(MY_ID, mframe_parser, &demo);
+  add_frame_handler(link, JOIN_EVENT, route_update_parser, &demo);
+  add_frame_handler(link, LEAVE_EVENT, route_update_parser, &demo);
+  add_frame_handler(link, RTBLE_EVENT, route_update_parser, &demo);
+  node_join();
 
   //start the LED blinking cycle
-  servo_ctrl_init(link);
-  led_cycler_init(MY_ID, link);
+  servo_ctrl_init(&demo, link);
+  led_cycler_init(&demo, MY_ID, link);
   //send_led_msg(1);
 }
 
@@ -64,8 +64,8 @@ void setup()
 void loop()
 {
   net_task(0);
-  joystick_servo();
-  send_led_msg(0);
+  joystick_servo(&demo);
+  send_led_msg(&demo, 0);
   //delay(100);
 }
 
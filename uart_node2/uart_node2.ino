@@ -10,36 +10,36 @@
 //Others
 #define NET_INIT_DELAY 1000
 
-LINK *link;
-
-//Declared in led_cycler.cpp
-extern uint8_t led_intensity;
-extern uint8_t led_on;
+DEMO demo;
 
 //Overriding the message frame handler, so we can parse commands specific to our application
-void mframe_parser(FRAME frame)
+void mframe_parser(const FRAME &frame, LINK *link, void *ctx)
 {
+  DEMO *demo = (DEMO*)ctx;
+
   if (strncmp(frame.payload, "!MVSV", 5) == 0)
   {
     printf("!MVSV from %u\n", frame.src);
-    parse_mvsv_cmd(frame);
+    parse_mvsv_cmd(demo, frame);
   }
   else if (strncmp(frame.payload, "!TLED", 5) == 0)
   {
     printf("!TLED from %u\n", frame.src);
-    toggle_led();
+    toggle_led(demo);
   }
 }
 
 //Callback for JOIN, LEAVE, and RTBLE. Needed by LED cycler
-void route_update_parser(FRAME frame)
+void route_update_parser(const FRAME &frame, LINK *link, void *ctx)
 {
-  led_peer_update();
+  led_peer_update((DEMO*)ctx);
 }
 
 
 void setup()
 {
+  LINK *link;
+
   //Initialize GPIOs
   pinMode(DEMO_LED_PIN, OUTPUT);      //Demo LED
   pinMode(ACTIVITY_LED_PIN, OUTPUT);  //Link Activity LED
@@ -50,22 +50,23 @@ void setup()
 
   //Setup the network
   delay(NET_INIT_DELAY);                  //Give the switch a bit of time to initialize
-  link = node_init(MY_ID, mframe_parser);
-  set_join_handler(route_update_parser);
-  set_leave_handler(route_update_parser);
-  set_rtble_handler(route_update_parser);
-  send_join_msg(link->id, link);
+  link = node_init(MY_ID, mframe_parser, &demo);
+  add_frame_handler(link, JOIN_EVENT, route_update_parser, &demo);
+  add_frame_handler(link, LEAVE_EVENT, route_update_parser, &demo);
+  add_frame_handler(link, RTBLE_EVENT, route_update_parser, &demo);
+  node_join();
+  node_join_group(MVSV_GROUP);            //Follow the joystick's servo commands
 
   //start the LED blinking cycle 
-  servo_ctrl_init(link);
-  led_cycler_init(MY_ID, link);
+  servo_ctrl_init(&demo, link);
+  led_cycler_init(&demo, MY_ID, link);
 }
 
 
 void loop()
 {
   net_task(0);
-  send_led_msg(0);
+  send_led_msg(&demo, 0);
 }
 
 